@@ -6,6 +6,16 @@
 namespace luna {
 	namespace live2d {
 
+		/**
+		 * @brief A drawable id that has been resolved to an index once, see Model::getDrawableHandle.
+		 * Looking up a Drawable through a handle is a single array access.
+		*/
+		struct DrawableHandle {
+			uint32_t index = uint32_t(-1);
+
+			bool isValid() const { return index != uint32_t(-1); }
+		};
+
 		/**
 		 * @brief A drawable part of the Live2D model, see the Cubism SDK documentation for reference 
 		*/
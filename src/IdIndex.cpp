@@ -0,0 +1,79 @@
+#include "IdIndex.hpp"
+
+#include <cstring>
+
+namespace luna {
+	namespace live2d {
+
+		IdIndex::IdIndex(const char* const* ids, size_t count) {
+			// keep the load factor at or below 0.5 so probe sequences stay short
+			size_t slotCount = 4;
+			while (slotCount < count * 2)
+				slotCount *= 2;
+
+			m_slots.resize(slotCount, Slot{ 0, EmptySlot });
+			m_slotMask = uint32_t(slotCount - 1);
+			m_idOffsets.reserve(count + 1);
+
+			for (size_t i = 0; i < count; ++i) {
+				size_t length;
+				uint32_t idHash = hash(ids[i], length);
+
+				// store a copy of the id, so the index does not depend on the lifetime of a csmModel
+				m_idOffsets.push_back(uint32_t(m_idData.size()));
+				m_idData.insert(m_idData.end(), ids[i], ids[i] + length + 1);
+
+				// duplicate ids keep the first occurrence, just like a linear search would
+				if (find(ids[i]) != npos)
+					continue;
+
+				uint32_t slot = idHash & m_slotMask;
+				while (m_slots[slot].index != EmptySlot)
+					slot = (slot + 1) & m_slotMask;
+				m_slots[slot] = Slot{ idHash, uint32_t(i) };
+			}
+		}
+
+		size_t IdIndex::find(const char* id) const {
+			if (m_slots.empty() || !id)
+				return npos;
+
+			size_t length;
+			uint32_t idHash = hash(id, length);
+
+			for (uint32_t slot = idHash & m_slotMask; m_slots[slot].index != EmptySlot; slot = (slot + 1) & m_slotMask) {
+				const Slot& s = m_slots[slot];
+				if (s.hash == idHash && std::memcmp(getId(s.index), id, length + 1) == 0)
+					return s.index;
+			}
+
+			return npos;
+		}
+
+		const char* IdIndex::getId(size_t index) const {
+			return m_idData.data() + m_idOffsets[index];
+		}
+
+		size_t IdIndex::size() const {
+			return m_idOffsets.size();
+		}
+
+		bool IdIndex::empty() const {
+			return m_idOffsets.empty();
+		}
+
+		uint32_t IdIndex::hash(const char* id, size_t& length) {
+			// FNV-1a, computes the length in the same pass so we never need a strlen or std::string
+			uint32_t result = 2166136261u;
+			const char* c = id;
+			for (; *c; ++c) {
+				result ^= uint8_t(*c);
+				result *= 16777619u;
+			}
+
+			length = size_t(c - id);
+			return result;
+		}
+
+	}
+}
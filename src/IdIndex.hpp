@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace luna {
+	namespace live2d {
+
+		/**
+		 * @brief A flat open-addressing hash table that maps the ids of a Live2D model (parameter ids,
+		 * drawable ids, ...) to their index. It is built once by the Model and shared by all of its
+		 * instances, so looking up an id never allocates and never scans the whole list.
+		*/
+		class IdIndex {
+		public:
+			static constexpr size_t npos = size_t(-1);
+
+			IdIndex() = default;
+
+			/**
+			 * @brief Builds the index, the id at ids[i] will map to index i
+			 * @param ids The ids to put in the index, these get copied
+			 * @param count The amount of ids
+			*/
+			IdIndex(const char* const* ids, size_t count);
+
+			/**
+			 * @brief Looks up the index of an id
+			 * @param id The id to search for
+			 * @return The index of the id, or npos when the id is not in the index
+			*/
+			size_t find(const char* id) const;
+
+			/**
+			 * @param index The index of the id
+			 * @return The id at this index, this pointer is owned by the IdIndex
+			*/
+			const char* getId(size_t index) const;
+
+			size_t size() const;
+			bool empty() const;
+
+		private:
+			static uint32_t hash(const char* id, size_t& length);
+
+		private:
+			static constexpr uint32_t EmptySlot = uint32_t(-1);
+
+			struct Slot {
+				uint32_t hash;
+				uint32_t index;
+			};
+
+			std::vector<Slot> m_slots;
+			std::vector<char> m_idData;
+			std::vector<uint32_t> m_idOffsets;
+			uint32_t m_slotMask = 0;
+		};
+
+	}
+}
@@ -3,8 +3,12 @@
 #include <luna.hpp>
 
 #include "Drawable.hpp"
+#include "IdIndex.hpp"
 #include "Model.hpp"
 #include "ModelInstance.hpp"
+#include "Motion.hpp"
+#include "MotionStack.hpp"
 #include "Parameter.hpp"
 #include "Physics.hpp"
+#include "PhysicsCache.hpp"
 #include "Renderer.hpp"
\ No newline at end of file
@@ -0,0 +1,126 @@
+#include "MappedFile.hpp"
+
+#include <string>
+#include <utility>
+#include <luna.hpp>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace luna {
+	namespace live2d {
+
+		MappedFile::MappedFile(const char* filepath) {
+#ifdef _WIN32
+			HANDLE file = CreateFileA(filepath, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+			if (file == INVALID_HANDLE_VALUE) {
+				log("File could not be opened (" + std::string(filepath) + ")", MessageSeverity::Error);
+				return;
+			}
+
+			LARGE_INTEGER fileSize;
+			if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0) {
+				log("File could not be mapped (" + std::string(filepath) + ")", MessageSeverity::Error);
+				CloseHandle(file);
+				return;
+			}
+
+			// PAGE_WRITECOPY + FILE_MAP_COPY gives a private copy-on-write view of the file
+			HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_WRITECOPY, 0, 0, nullptr);
+			if (mapping) {
+				m_data = MapViewOfFile(mapping, FILE_MAP_COPY, 0, 0, 0);
+				CloseHandle(mapping); // the view keeps the mapping alive
+			}
+			CloseHandle(file);
+
+			if (!m_data) {
+				log("File could not be mapped (" + std::string(filepath) + ")", MessageSeverity::Error);
+				return;
+			}
+
+			m_size = size_t(fileSize.QuadPart);
+#else
+			int file = open(filepath, O_RDONLY);
+			if (file == -1) {
+				log("File could not be opened (" + std::string(filepath) + ")", MessageSeverity::Error);
+				return;
+			}
+
+			struct stat fileStat;
+			if (fstat(file, &fileStat) != 0 || fileStat.st_size == 0) {
+				log("File could not be mapped (" + std::string(filepath) + ")", MessageSeverity::Error);
+				close(file);
+				return;
+			}
+
+			// MAP_PRIVATE gives a copy-on-write mapping, writes never reach the file
+			void* data = mmap(nullptr, size_t(fileStat.st_size), PROT_READ | PROT_WRITE, MAP_PRIVATE, file, 0);
+			close(file); // the mapping keeps the file alive
+
+			if (data == MAP_FAILED) {
+				log("File could not be mapped (" + std::string(filepath) + ")", MessageSeverity::Error);
+				return;
+			}
+
+			m_data = data;
+			m_size = size_t(fileStat.st_size);
+#endif
+		}
+
+		MappedFile::MappedFile(MappedFile&& other) noexcept :
+			m_data(std::exchange(other.m_data, nullptr)),
+			m_size(std::exchange(other.m_size, 0))
+		{}
+
+		MappedFile& MappedFile::operator=(MappedFile&& other) noexcept {
+			if (this != &other) {
+				unmap();
+				m_data = std::exchange(other.m_data, nullptr);
+				m_size = std::exchange(other.m_size, 0);
+			}
+			return *this;
+		}
+
+		MappedFile::~MappedFile() {
+			unmap();
+		}
+
+		bool MappedFile::isValid() const {
+			return m_data;
+		}
+
+		void* MappedFile::getData() {
+			return m_data;
+		}
+
+		const void* MappedFile::getData() const {
+			return m_data;
+		}
+
+		size_t MappedFile::getSize() const {
+			return m_size;
+		}
+
+		void MappedFile::unmap() {
+			if (!m_data)
+				return;
+
+#ifdef _WIN32
+			UnmapViewOfFile(m_data);
+#else
+			munmap(m_data, m_size);
+#endif
+			m_data = nullptr;
+			m_size = 0;
+		}
+
+	}
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstddef>
+
+namespace luna {
+	namespace live2d {
+
+		/**
+		 * @brief A file that is mapped into memory with a private copy-on-write mapping. The mapped memory can be
+		 * written to without ever modifying the file on disk, only the pages that are written to get copied.
+		 * The mapping is page aligned, which satisfies the alignment requirements of the Cubism Core.
+		*/
+		class MappedFile {
+		public:
+			MappedFile() = default;
+
+			/**
+			 * @brief Maps a file into memory
+			 * @param filepath The path to the file
+			*/
+			explicit MappedFile(const char* filepath);
+
+			MappedFile(MappedFile&) = delete;
+			MappedFile& operator=(MappedFile&) = delete;
+			MappedFile(MappedFile&& other) noexcept;
+			MappedFile& operator=(MappedFile&& other) noexcept;
+			~MappedFile();
+
+			bool isValid() const;
+			void* getData();
+			const void* getData() const;
+			size_t getSize() const;
+
+		private:
+			void unmap();
+
+		private:
+			void* m_data = nullptr;
+			size_t m_size = 0;
+		};
+
+	}
+}
@@ -1,11 +1,16 @@
 #include "Model.hpp"
 
+#include <algorithm>
 #include <filesystem>
 #include <fstream>
+#include <mutex>
+#include <unordered_map>
 #include <Live2DCubismCore.h>
 #include <nlohmann/json.hpp>
 
 #include "AlignedAllocator.hpp"
+#include "PhysicsCache.hpp"
+#include "ThreadPool.hpp"
 
 using json = nlohmann::json;
 
@@ -15,6 +20,21 @@ namespace luna {
 			constexpr int csmAlignofMoc = 64;
 			constexpr int csmAlignofModel = 16;
 			std::unique_ptr<luna::Shader> shader;
+
+			// a mapped moc is released by releasing the mapping, not by freeing the csmMoc itself
+			void releaseMappedMoc(void*) {}
+
+			struct SharedMoc {
+				std::weak_ptr<MappedFile> file;
+				csmMoc* moc;
+			};
+
+			float secondsSince(std::chrono::steady_clock::time_point start) {
+				return std::chrono::duration<float>(std::chrono::steady_clock::now() - start).count();
+			}
+
+			std::mutex sharedMocMutex;
+			std::unordered_map<std::string, SharedMoc> sharedMocs;
 		}
 
 		void initialize() {
@@ -40,13 +60,14 @@ namespace luna {
 				"};"
 
 				"uniform mat4 ModelMatrix;"
+				"uniform vec4 Live2DMaskTarget;"
 
 				"void main() {"
 				"	screenColor = ScreenColor;"
 				"	multiplyColor = MainColor * MultColor;"
 				"	uv = UV * MainTexture_ST.xy + MainTexture_ST.zw;"
 				"	clipPos = ProjectionMatrix * ViewMatrix * ModelMatrix * vec4(Position, 1.0);"
-				"	gl_Position = clipPos;"
+				"	gl_Position = vec4(clipPos.xy * Live2DMaskTarget.xy + Live2DMaskTarget.zw * clipPos.w, clipPos.zw);"
 				"}";
 
 			const char* fragSrc =
@@ -60,16 +81,20 @@ namespace luna {
 				"uniform sampler2D MainTexture;"
 				"uniform sampler2D Live2DMaskTexture;"
 				"uniform int Live2DMaskTextureInversed;"
+				"uniform vec4 Live2DMaskRegion;"
+				"uniform vec4 Live2DMaskBounds;"
 
 				"out vec4 fragColor;"
 
 				"float getMask() {"
-				"	float mask = texture(Live2DMaskTexture, (clipPos.xy / clipPos.w) * 0.5 + 0.5).a;"
+				"	vec2 maskUv = ((clipPos.xy / clipPos.w) * 0.5 + 0.5) * Live2DMaskRegion.xy + Live2DMaskRegion.zw;"
+				"	float mask = texture(Live2DMaskTexture, clamp(maskUv, Live2DMaskBounds.xy, Live2DMaskBounds.zw)).a;"
 				"	if (bool(Live2DMaskTextureInversed)) mask = 1.0 - mask;"
 				"	return mask;"
 				"}"
 
 				"void main() {"
+				"	if (any(greaterThan(abs(clipPos.xy), vec2(clipPos.w)))) discard;"
 				"	fragColor = texture(MainTexture, uv) * multiplyColor;"
 				"	fragColor.rgb = vec3(1.0) - (vec3(1.0) - screenColor) * (vec3(1.0) - fragColor.rgb);"
 				"	fragColor.a *= getMask();"
@@ -93,49 +118,115 @@ namespace luna {
 			load(filepath, flags);
 		}
 
+		Model::~Model() {
+			reset();
+		}
+
 		void Model::load(const char* filepath, LoadFlags flags) {
 			// unload the model
 			reset();
+			m_loadStart = Clock::now();
 
-			// open model file
-			auto root = std::filesystem::path(filepath).parent_path();
-			std::string rootStr = root.string() + "/";
+			FileReferences references;
+			if (!readModelFile(filepath, flags, references))
+				return;
 
-			std::ifstream file(filepath);
-			if (file.bad() || file.fail() || file.eof()) {
-				log("Could not open file at \"" + std::string(filepath) + "\"", MessageSeverity::Error);
-				reset();
+			loadTextures(references.textures);
+			if (!references.physics.empty())
+				loadPhysics(references.physics.c_str());
+			if (!references.motions.empty())
+				loadMotions(references.motions);
+			loadMoc(references.moc.c_str(), flags);
+
+			completeLoad();
+		}
+
+		void Model::loadAsync(const char* filepath, LoadFlags flags) {
+			// unload the model
+			reset();
+			m_loadStart = Clock::now();
+
+			// the model file is small and tells us what to load, so it is read right away
+			FileReferences references;
+			if (!readModelFile(filepath, flags, references))
 				return;
-			}
-			json modelFile = json::parse(file);
-			auto& fileReferences = modelFile.at("FileReferences");
 
-			// load textures
-			auto& textureReferences = fileReferences.at("Textures");
-			for (std::string texturePath : textureReferences) {
-				m_textures.push_back(luna::Texture::loadFromFile((rootStr + texturePath).c_str()));
-				m_textures.back().generateMipmap();
-				m_textures.back().enableAnisotropicFiltering(4.0f);
-				m_materials.emplace_back(shader.get());
-				m_materials.back().setMainTexture(&m_textures.back());
-			}
+			// the moc, physics and motions only touch their own members, so they can be loaded on the workers
+			auto& pool = ThreadPool::getShared();
+			m_pendingMoc = pool.submit([this, path = std::move(references.moc), flags]() { loadMoc(path.c_str(), flags); });
+			if (!references.physics.empty())
+				m_pendingPhysics = pool.submit([this, path = std::move(references.physics)]() { loadPhysics(path.c_str()); });
+			if (!references.motions.empty())
+				m_pendingMotions = pool.submit([this, motions = std::move(references.motions)]() { loadMotions(motions); });
+
+			// luna decodes and uploads a texture in one go, so textures are left for the owning thread
+			m_pendingTextures = std::move(references.textures);
+			m_loading = true;
+		}
+
+		bool Model::finishLoad(bool wait) {
+			if (!m_loading)
+				return true;
 
-			// load physics
-			if (!(flags & NoPhysics) && fileReferences.contains("Physics")) {
-				std::string physicsPath = fileReferences.at("Physics");
-				m_physicsControllerPrototype = std::make_unique<PhysicsController>((rootStr + physicsPath).c_str());
+			// load the textures while the workers are still busy
+			if (!m_pendingTextures.empty()) {
+				loadTextures(m_pendingTextures);
+				m_pendingTextures.clear();
 			}
 
-			// load .moc file
-			std::string mocPath = fileReferences.at("Moc");
-			loadMoc((rootStr + mocPath).c_str());
+			auto isReady = [](const std::future<void>& future) {
+				return !future.valid() || future.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+			};
+
+			if (!wait && !(isReady(m_pendingMoc) && isReady(m_pendingPhysics) && isReady(m_pendingMotions)))
+				return false;
+
+			// get() rethrows anything that went wrong on a worker
+			m_loading = false;
+			if (m_pendingMoc.valid())
+				m_pendingMoc.get();
+			if (m_pendingPhysics.valid())
+				m_pendingPhysics.get();
+			if (m_pendingMotions.valid())
+				m_pendingMotions.get();
+
+			completeLoad();
+			return true;
+		}
+
+		bool Model::isLoading() const {
+			return m_loading;
+		}
+
+		const ModelLoadTimings& Model::getLoadTimings() const {
+			return m_loadTimings;
 		}
 
 		void Model::reset() {
+			// workers might still be writing into this model
+			if (m_pendingMoc.valid())
+				m_pendingMoc.wait();
+			if (m_pendingPhysics.valid())
+				m_pendingPhysics.wait();
+			if (m_pendingMotions.valid())
+				m_pendingMotions.wait();
+			m_pendingMoc = {};
+			m_pendingPhysics = {};
+			m_pendingMotions = {};
+			m_pendingTextures.clear();
+			m_loading = false;
+			m_loadTimings = {};
+
 			m_moc.reset();
-			m_physicsControllerPrototype.reset();
+			m_mocFile.reset();
+			m_physicsRig.reset();
+			m_motionGroups.clear();
+			m_motions.clear();
 			m_textures.clear();
 			m_materials.clear();
+			m_parameterIndex = IdIndex();
+			m_drawableIndex = IdIndex();
+			m_partIndex = IdIndex();
 		}
 
 		CoreModel Model::createCoreModel() const {
@@ -144,13 +235,54 @@ namespace luna {
 				void* modelMemory = AlignedAllocator::allocate(modelSize, csmAlignofModel);
 				return CoreModel(csmInitializeModelInPlace(m_moc.get(), modelMemory, modelSize), AlignedAllocator::deallocate);
 			}
+			return CoreModel(nullptr, AlignedAllocator::deallocate);
 		}
 
 
 		std::unique_ptr<PhysicsController> Model::createPhysicsController() const {
-			if (!m_physicsControllerPrototype)
+			if (!m_physicsRig)
 				return nullptr;
-			return std::make_unique<PhysicsController>(*m_physicsControllerPrototype);
+			return std::make_unique<PhysicsController>(m_physicsRig.get());
+		}
+
+		const PhysicsRig* Model::getPhysicsRig() const {
+			return m_physicsRig.get();
+		}
+
+		size_t Model::getMotionGroupCount() const {
+			return m_motionGroups.size();
+		}
+
+		const MotionGroup* Model::getMotionGroups() const {
+			return m_motionGroups.data();
+		}
+
+		const MotionGroup* Model::getMotionGroup(const char* name) const {
+			for (auto& group : m_motionGroups) {
+				if (group.name == name)
+					return &group;
+			}
+			return nullptr;
+		}
+
+		const Motion* Model::getMotion(const char* group, size_t index) const {
+			const MotionGroup* motionGroup = getMotionGroup(group);
+			return motionGroup && index < motionGroup->motions.size() ? motionGroup->motions[index].motion : nullptr;
+		}
+
+		float Model::bakeMotions(float rate, bool includeRestricted, std::vector<const Motion*>* skipped) {
+			float maxError = 0.0f;
+			if (skipped)
+				skipped->clear();
+
+			for (auto& motion : m_motions) {
+				if (includeRestricted || !motion->areBeziersRestricted())
+					maxError = std::max(maxError, motion->bake(rate).maxError);
+
+				if (skipped && !motion->isBaked())
+					skipped->push_back(motion.get());
+			}
+			return maxError;
 		}
 
 		bool Model::isValid() const {
@@ -189,6 +321,28 @@ namespace luna {
 			return m_materials.data();
 		}
 
+		ParameterHandle Model::getParameterHandle(const char* id) const {
+			size_t index = m_parameterIndex.find(id);
+			return index == IdIndex::npos ? ParameterHandle() : ParameterHandle{ uint32_t(index) };
+		}
+
+		DrawableHandle Model::getDrawableHandle(const char* id) const {
+			size_t index = m_drawableIndex.find(id);
+			return index == IdIndex::npos ? DrawableHandle() : DrawableHandle{ uint32_t(index) };
+		}
+
+		const IdIndex& Model::getParameterIndex() const {
+			return m_parameterIndex;
+		}
+
+		const IdIndex& Model::getDrawableIndex() const {
+			return m_drawableIndex;
+		}
+
+		const IdIndex& Model::getPartIndex() const {
+			return m_partIndex;
+		}
+
 		void* Model::readFileAligned(const char* path, unsigned int alignment, size_t& size) {
 			std::ifstream file(path, std::ios::binary | std::ios::ate);
 			if (file.fail()) {
@@ -205,25 +359,206 @@ namespace luna {
 			return data;
 		}
 
-		void Model::loadMoc(const char* filepath) {
+		bool Model::readModelFile(const char* filepath, LoadFlags flags, FileReferences& references) {
+			auto start = Clock::now();
+
+			// open model file
+			auto root = std::filesystem::path(filepath).parent_path();
+			std::string rootStr = root.string() + "/";
+
+			std::ifstream file(filepath);
+			if (file.bad() || file.fail() || file.eof()) {
+				log("Could not open file at \"" + std::string(filepath) + "\"", MessageSeverity::Error);
+				return false;
+			}
+			json modelFile = json::parse(file);
+			auto& fileReferences = modelFile.at("FileReferences");
+
+			for (std::string texturePath : fileReferences.at("Textures"))
+				references.textures.push_back(rootStr + texturePath);
+
+			if (!(flags & NoPhysics) && fileReferences.contains("Physics"))
+				references.physics = rootStr + fileReferences.at("Physics").get<std::string>();
+
+			references.moc = rootStr + fileReferences.at("Moc").get<std::string>();
+
+			if (!(flags & NoMotions) && fileReferences.contains("Motions")) {
+				for (auto& [group, motions] : fileReferences.at("Motions").items()) {
+					for (auto& motion : motions) {
+						references.motions.push_back({
+							group,
+							rootStr + motion.at("File").get<std::string>(),
+							motion.value("FadeInTime", -1.0f),
+							motion.value("FadeOutTime", -1.0f)
+						});
+					}
+				}
+			}
+
+			m_loadTimings.modelFile = secondsSince(start);
+			return true;
+		}
+
+		void Model::loadTextures(const std::vector<std::string>& paths) {
+			auto start = Clock::now();
+
+			for (const auto& texturePath : paths) {
+				m_textures.push_back(luna::Texture::loadFromFile(texturePath.c_str()));
+				m_textures.back().generateMipmap();
+				m_textures.back().enableAnisotropicFiltering(4.0f);
+				m_materials.emplace_back(shader.get());
+				m_materials.back().setMainTexture(&m_textures.back());
+			}
+
+			m_loadTimings.textures = secondsSince(start);
+		}
+
+		void Model::loadPhysics(const char* filepath) {
+			auto start = Clock::now();
+
+			// prefer the precompiled physics when it is present and up to date
+			m_physicsRig = PhysicsCache::read(PhysicsCache::getCachePath(filepath).c_str(), filepath);
+			if (!m_physicsRig)
+				m_physicsRig = std::make_unique<PhysicsRig>(filepath);
+
+			m_loadTimings.physics = secondsSince(start);
+		}
+
+		void Model::loadMotions(const std::vector<MotionReference>& references) {
+			auto start = Clock::now();
+
+			std::map<std::string, const Motion*> loaded;
+			for (const auto& reference : references) {
+				const Motion*& motion = loaded[reference.path];
+				if (!motion) {
+					m_motions.push_back(std::make_unique<Motion>(reference.path.c_str()));
+					motion = m_motions.back().get();
+				}
+
+				auto group = std::find_if(m_motionGroups.begin(), m_motionGroups.end(), [&](const MotionGroup& g) { return g.name == reference.group; });
+				if (group == m_motionGroups.end())
+					group = m_motionGroups.insert(m_motionGroups.end(), MotionGroup{ reference.group, {} });
+
+				group->motions.push_back({ motion, reference.fadeInTime, reference.fadeOutTime });
+			}
+
+			m_loadTimings.motions = secondsSince(start);
+		}
+
+		void Model::loadMoc(const char* filepath, LoadFlags flags) {
+			auto start = Clock::now();
+
+			if (flags & (MapMoc | ShareMoc)) {
+				mapMoc(filepath, flags & ShareMoc);
+			} else {
+				copyMoc(filepath);
+			}
+
+			m_loadTimings.moc = secondsSince(start);
+		}
+
+		void Model::copyMoc(const char* filepath) {
 			// read file
 			size_t mocSize;
 			void* mocMemory = readFileAligned(filepath, csmAlignofMoc, mocSize);
-			if (mocMemory == nullptr) {
-				reset();
+			if (mocMemory == nullptr)
 				return;
-			}
 
 			// check for malformation
 			int consistency = csmHasMocConsistency(mocMemory, unsigned(mocSize));
 			if (!consistency) {
 				log("Live2D model file is malformed (" + std::string(filepath) + ")", MessageSeverity::Error);
-				reset();
+				AlignedAllocator::deallocate(mocMemory);
 				return;
 			}
 
 			// load file and model
 			m_moc = CoreMoc(csmReviveMocInPlace(mocMemory, unsigned(mocSize)), AlignedAllocator::deallocate);
 		}
+
+		void Model::mapMoc(const char* filepath, bool shared) {
+			std::string key = std::filesystem::weakly_canonical(filepath).string();
+			std::unique_lock lock(sharedMocMutex, std::defer_lock);
+
+			// reuse the mapping of another Model
+			if (shared) {
+				lock.lock();
+				auto it = sharedMocs.find(key);
+				if (it != sharedMocs.end()) {
+					m_mocFile = it->second.file.lock();
+					if (m_mocFile) {
+						m_moc = CoreMoc(it->second.moc, releaseMappedMoc);
+						return;
+					}
+					sharedMocs.erase(it);
+				}
+			}
+
+			// map file, the mapping is page aligned so it always satisfies csmAlignofMoc
+			auto file = std::make_shared<MappedFile>(filepath);
+			if (!file->isValid())
+				return;
+
+			// check for malformation
+			int consistency = csmHasMocConsistency(file->getData(), unsigned(file->getSize()));
+			if (!consistency) {
+				log("Live2D model file is malformed (" + std::string(filepath) + ")", MessageSeverity::Error);
+				return;
+			}
+
+			// reviving writes into the mapping, which only touches our private copy of the pages
+			csmMoc* moc = csmReviveMocInPlace(file->getData(), unsigned(file->getSize()));
+			if (!moc)
+				return;
+
+			// drop the entries of mocs no Model uses anymore, otherwise one is left behind for every file that was ever shared
+			if (shared) {
+				std::erase_if(sharedMocs, [](const auto& entry) { return entry.second.file.expired(); });
+				sharedMocs[key] = SharedMoc{ file, moc };
+			}
+
+			m_mocFile = std::move(file);
+			m_moc = CoreMoc(moc, releaseMappedMoc);
+		}
+
+		void Model::completeLoad() {
+			// without a moc there is no model, unload whatever did load
+			if (!m_moc) {
+				reset();
+				return;
+			}
+
+			buildIdIndices();
+			if (m_physicsRig)
+				m_physicsRig->bindTo(*this);
+			for (auto& motion : m_motions)
+				motion->bindTo(*this);
+
+			m_loadTimings.total = secondsSince(m_loadStart);
+		}
+
+		void Model::buildIdIndices() {
+			// the ids can only be queried from a csmModel, so create a temporary one
+			CoreModel coreModel = createCoreModel();
+			if (!coreModel)
+				return;
+
+			m_parameterIndex = IdIndex(csmGetParameterIds(coreModel.get()), size_t(csmGetParameterCount(coreModel.get())));
+			m_partIndex = IdIndex(csmGetPartIds(coreModel.get()), size_t(csmGetPartCount(coreModel.get())));
+
+			// ModelInstance skips drawables with an invalid texture index, so the index has to skip them too
+			int drawableCount = csmGetDrawableCount(coreModel.get());
+			const char** ids = csmGetDrawableIds(coreModel.get());
+			const int* textureIndices = csmGetDrawableTextureIndices(coreModel.get());
+
+			std::vector<const char*> drawableIds;
+			drawableIds.reserve(drawableCount);
+			for (int i = 0; i < drawableCount; ++i) {
+				if (size_t(textureIndices[i]) < getMaterialCount())
+					drawableIds.push_back(ids[i]);
+			}
+
+			m_drawableIndex = IdIndex(drawableIds.data(), drawableIds.size());
+		}
 	}
 }
\ No newline at end of file
@@ -1,7 +1,16 @@
 #pragma once
 
+#include <chrono>
+#include <future>
+#include <map>
+#include <mutex>
 #include <luna.hpp>
 
+#include "Drawable.hpp"
+#include "IdIndex.hpp"
+#include "MappedFile.hpp"
+#include "Motion.hpp"
+#include "Parameter.hpp"
 #include "Physics.hpp"
 
 struct csmMoc;
@@ -15,6 +24,19 @@ namespace luna {
 		using CoreMoc = std::unique_ptr<csmMoc, void(*)(void*)>;
 		using CoreModel = std::unique_ptr<csmModel, void(*)(void*)>;
 
+		/**
+		 * @brief How long each stage of loading a Model took, in seconds. When the Model is loaded with
+		 * Model::loadAsync the moc and physics stages run in parallel, so they overlap with the textures.
+		*/
+		struct ModelLoadTimings {
+			float modelFile = 0.0f;
+			float textures = 0.0f;
+			float physics = 0.0f;
+			float motions = 0.0f;
+			float moc = 0.0f;
+			float total = 0.0f;
+		};
+
 		/**
 		 * @brief A Live2D model, the file it needs is the .model3.json file outputted by Live2D.
 		 * This class only imports the file, to actually render the model, see ModelInstance.hpp
@@ -24,6 +46,22 @@ namespace luna {
 			enum LoadFlags {
 				None = 0x0,
 				NoPhysics = 0x1,
+
+				/**
+				 * @brief Memory-map the .moc3 file with a private copy-on-write mapping and revive it in place,
+				 * instead of copying the file into an aligned heap buffer
+				*/
+				MapMoc = 0x2,
+
+				/**
+				 * @brief Like MapMoc, but Models that load the same .moc3 file share a single mapping and csmMoc
+				*/
+				ShareMoc = 0x4,
+
+				/**
+				 * @brief Skip the motions listed in the .model3.json file
+				*/
+				NoMotions = 0x8,
 			};
 
 			Model();
@@ -33,12 +71,43 @@ namespace luna {
 			*/
 			explicit Model(const char* filepath, LoadFlags = None);
 
+			Model(Model&) = delete;
+			Model& operator=(Model&) = delete;
+			Model(Model&&) = delete;
+			Model& operator=(Model&&) = delete;
+			~Model();
+
 			/**
 			 * @brief Loads in the model from a file
 			 * @param filepath The path to the .model3.json file
 			*/
 			void load(const char* filepath, LoadFlags = None);
 
+			/**
+			 * @brief Starts loading the model from a file. The .moc3, physics and motion files are loaded on a worker
+			 * pool, the Model is not usable until finishLoad() returned true.
+			 * @param filepath The path to the .model3.json file
+			*/
+			void loadAsync(const char* filepath, LoadFlags = None);
+
+			/**
+			 * @brief Finishes a load started with loadAsync(). This has to be called on the thread that owns the
+			 * graphics context, since the textures get loaded and uploaded here.
+			 * @param wait Whether to block until the workers are done. When false, this can be polled every frame.
+			 * @return True when the Model is done loading, or when there was no load in progress
+			*/
+			bool finishLoad(bool wait = true);
+
+			/**
+			 * @return True while a load started with loadAsync() has not been finished yet
+			*/
+			bool isLoading() const;
+
+			/**
+			 * @return How long each stage of the last load took
+			*/
+			const ModelLoadTimings& getLoadTimings() const;
+
 			/**
 			 * @brief Removes all the contents of this Model
 			*/
@@ -53,10 +122,45 @@ namespace luna {
 			/**
 			 * @brief Creates a PhysicsController based on the loaded model
 			 * @return A new PhysicsController based on the .physics3.json file that
-			 * this class has loaded.
+			 * this class has loaded. It shares the PhysicsRig of this Model.
 			*/
 			std::unique_ptr<PhysicsController> createPhysicsController() const;
 
+			/**
+			 * @return The physics settings of this model, or nullptr if the model has no physics
+			*/
+			const PhysicsRig* getPhysicsRig() const;
+
+			/**
+			 * @brief The motion groups listed in the .model3.json file. The motions are loaded and bound to this model
+			 * once, every instance that plays them only keeps its own playback state.
+			*/
+			size_t getMotionGroupCount() const;
+			const MotionGroup* getMotionGroups() const;
+
+			/**
+			 * @param name The name of the group, like "Idle"
+			 * @return The group, or nullptr if the model has no group with this name
+			*/
+			const MotionGroup* getMotionGroup(const char* name) const;
+
+			/**
+			 * @return The motion at index in the group, or nullptr if there is no such motion
+			*/
+			const Motion* getMotion(const char* group, size_t index) const;
+
+			/**
+			 * @brief Bakes the motions of this model into fixed-rate sample tables, see Motion::bake. Call this once the
+			 * model is done loading and before any instance plays a motion.
+			 * @param rate The samples per second, 0 uses the Fps of every motion
+			 * @param includeRestricted Whether to bake motions with restricted beziers as well. Those are evaluated
+			 * directly without solving for the bezier parameter, which is about as fast as the baked tables.
+			 * @param skipped Receives the motions that were not baked: the ones with restricted beziers (unless
+			 * includeRestricted is set) and the ones where every curve has stepped segments. Can be nullptr.
+			 * @return The largest error of the baked motions
+			*/
+			float bakeMotions(float rate = 0.0f, bool includeRestricted = false, std::vector<const Motion*>* skipped = nullptr);
+
 			bool isValid() const;
 			const CoreMoc& getMoc() const;
 			CoreMoc& getMoc();
@@ -69,20 +173,91 @@ namespace luna {
 			const luna::Material* getMaterials() const;
 			luna::Material* getMaterials();
 
+			/**
+			 * @brief Resolves a parameter id to a handle, which can be used to look up the Parameter
+			 * in any ModelInstance of this Model without hashing or comparing strings.
+			 * @param id The id of the parameter
+			 * @return The handle, which is invalid if the model has no parameter with this id
+			*/
+			ParameterHandle getParameterHandle(const char* id) const;
+
+			/**
+			 * @brief Resolves a drawable id to a handle, which can be used to look up the Drawable
+			 * in any ModelInstance of this Model without hashing or comparing strings.
+			 * @param id The id of the drawable
+			 * @return The handle, which is invalid if the model has no drawable with this id
+			*/
+			DrawableHandle getDrawableHandle(const char* id) const;
+
+			const IdIndex& getParameterIndex() const;
+			const IdIndex& getDrawableIndex() const;
+
+			/**
+			 * @brief Maps the part ids of this model to their index in ModelInstance::getPartOpacities()
+			*/
+			const IdIndex& getPartIndex() const;
+
 			static luna::Shader* getShader();
 
 		private:
+			using Clock = std::chrono::steady_clock;
+
+			struct MotionReference {
+				std::string group;
+				std::string path;
+				float fadeInTime;
+				float fadeOutTime;
+			};
+
+			struct FileReferences {
+				std::string moc;
+				std::string physics;
+				std::vector<std::string> textures;
+				std::vector<MotionReference> motions;
+			};
+
 			static void* readFileAligned(const char* path, unsigned int alignment, size_t& size);
-			void loadMoc(const char* filepath);
+			bool readModelFile(const char* filepath, LoadFlags flags, FileReferences& references);
+			void loadTextures(const std::vector<std::string>& paths);
+			void loadPhysics(const char* filepath);
+			void loadMotions(const std::vector<MotionReference>& references);
+			void loadMoc(const char* filepath, LoadFlags flags);
+			void copyMoc(const char* filepath);
+			void mapMoc(const char* filepath, bool shared);
+			void completeLoad();
+			void buildIdIndices();
 
 		private:
+			// declared before m_moc, so the mapping outlives the csmMoc that lives inside of it
+			std::shared_ptr<MappedFile> m_mocFile;
 			CoreMoc m_moc;
 
-			std::unique_ptr<PhysicsController> m_physicsControllerPrototype;
+			std::unique_ptr<PhysicsRig> m_physicsRig;
+
+			// a motion that is listed more than once is only loaded once, the groups point into m_motions
+			std::vector<std::unique_ptr<Motion>> m_motions;
+			std::vector<MotionGroup> m_motionGroups;
 
 			std::vector<luna::Texture> m_textures;
 			std::vector<luna::Material> m_materials;
+
+			IdIndex m_parameterIndex;
+			IdIndex m_drawableIndex;
+			IdIndex m_partIndex;
+
+			std::future<void> m_pendingMoc;
+			std::future<void> m_pendingPhysics;
+			std::future<void> m_pendingMotions;
+			std::vector<std::string> m_pendingTextures;
+			bool m_loading = false;
+
+			Clock::time_point m_loadStart;
+			ModelLoadTimings m_loadTimings;
 		};
 
+		inline Model::LoadFlags operator|(Model::LoadFlags a, Model::LoadFlags b) {
+			return Model::LoadFlags(int(a) | int(b));
+		}
+
 	}
 }
\ No newline at end of file
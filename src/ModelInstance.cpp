@@ -3,6 +3,7 @@
 #include <filesystem>
 #include <fstream>
 #include <cassert>
+#include <type_traits>
 #include <Live2DCubismCore.h>
 
 #include "AlignedAllocator.hpp"
@@ -10,6 +11,9 @@
 namespace luna {
 	namespace live2d {
 
+		// the motion stack and the physics controller keep a pointer to the instance they were attached to
+		static_assert(!std::is_move_constructible_v<ModelInstance> && !std::is_move_assignable_v<ModelInstance>);
+
 		ModelInstance::ModelInstance(Model* model) :
 			m_coreModel(model ? model->createCoreModel() : CoreModel(nullptr, AlignedAllocator::deallocate)),
 			m_model(model),
@@ -28,6 +32,7 @@ namespace luna {
 
 			if (m_physicsController)
 				m_physicsController->attachTo(this);
+			m_motionStack.attachTo(this);
 		}
 
 		Model* ModelInstance::getModel() {
@@ -47,6 +52,9 @@ namespace luna {
 		}
 
 		void ModelInstance::update(float deltatime) {
+			// the motion goes first, the physics read the parameters it writes
+			m_motionStack.update(deltatime);
+
 			if (m_physicsController)
 				m_physicsController->update(deltatime);
 
@@ -56,6 +64,24 @@ namespace luna {
 			}
 		}
 
+		MotionStack* ModelInstance::getMotionStack() {
+			return &m_motionStack;
+		}
+
+		const MotionStack* ModelInstance::getMotionStack() const {
+			return &m_motionStack;
+		}
+
+		bool ModelInstance::playMotion(const char* group, size_t index, size_t layer) {
+			const MotionGroup* motionGroup = m_model ? m_model->getMotionGroup(group) : nullptr;
+			if (!motionGroup || index >= motionGroup->motions.size() || layer >= m_motionStack.getLayerCount())
+				return false;
+
+			const MotionEntry& entry = motionGroup->motions[index];
+			m_motionStack.play(layer, entry.motion, entry.fadeInTime, entry.fadeOutTime);
+			return true;
+		}
+
 		void ModelInstance::setTransform(const Transform& transform) {
 			m_transform = transform;
 		}
@@ -93,15 +119,31 @@ namespace luna {
 		}
 
 		const Drawable* ModelInstance::getDrawable(const char* id) const {
-			std::hash<std::string> hasher;
-			auto it = std::find_if(m_drawables.begin(), m_drawables.end(), [hash = hasher(id)](const Drawable& x) { return x.getIdHash() == hash; });
-			return it == m_drawables.end() ? &(*it) : nullptr;
+			return m_model ? getDrawable(m_model->getDrawableHandle(id)) : nullptr;
 		}
 
 		Drawable* ModelInstance::getDrawable(const char* id) {
-			std::hash<std::string> hasher;
-			auto it = std::find_if(m_drawables.begin(), m_drawables.end(), [hash = hasher(id)](const Drawable& x) { return x.getIdHash() == hash; });
-			return it == m_drawables.end() ? &(*it) : nullptr;
+			return m_model ? getDrawable(m_model->getDrawableHandle(id)) : nullptr;
+		}
+
+		const Drawable* ModelInstance::getDrawable(DrawableHandle handle) const {
+			return handle.index < m_drawables.size() ? &m_drawables[handle.index] : nullptr;
+		}
+
+		Drawable* ModelInstance::getDrawable(DrawableHandle handle) {
+			return handle.index < m_drawables.size() ? &m_drawables[handle.index] : nullptr;
+		}
+
+		const csmFlags* ModelInstance::getDynamicFlags() const {
+			return m_coreModel ? csmGetDrawableDynamicFlags(m_coreModel.get()) : nullptr;
+		}
+
+		size_t ModelInstance::getCoreDrawableCount() const {
+			return m_coreModel ? size_t(csmGetDrawableCount(m_coreModel.get())) : 0;
+		}
+
+		size_t ModelInstance::getCoreDrawableIndex(size_t drawableIdx) const {
+			return m_coreDrawableIndices[drawableIdx];
 		}
 
 		size_t ModelInstance::getParameterCount() const {
@@ -117,15 +159,51 @@ namespace luna {
 		}
 
 		const Parameter* ModelInstance::getParameter(const char* id) const {
-			std::hash<std::string> hasher;
-			auto it = std::find_if(m_parameters.begin(), m_parameters.end(), [hash = hasher(id)](const Parameter& x) { return x.getIdHash() == hash; });
-			return it == m_parameters.end() ? nullptr : &(*it);
+			return m_model ? getParameter(m_model->getParameterHandle(id)) : nullptr;
 		}
 
 		Parameter* ModelInstance::getParameter(const char* id) {
-			std::hash<std::string> hasher;
-			auto it = std::find_if(m_parameters.begin(), m_parameters.end(), [hash = hasher(id)](const Parameter& x) { return x.getIdHash() == hash; });
-			return it == m_parameters.end() ? nullptr : &(*it);
+			return m_model ? getParameter(m_model->getParameterHandle(id)) : nullptr;
+		}
+
+		const Parameter* ModelInstance::getParameter(ParameterHandle handle) const {
+			return handle.index < m_parameters.size() ? &m_parameters[handle.index] : nullptr;
+		}
+
+		Parameter* ModelInstance::getParameter(ParameterHandle handle) {
+			return handle.index < m_parameters.size() ? &m_parameters[handle.index] : nullptr;
+		}
+
+		float* ModelInstance::getParameterValues() {
+			return m_coreModel ? csmGetParameterValues(m_coreModel.get()) : nullptr;
+		}
+
+		const float* ModelInstance::getParameterValues() const {
+			return m_coreModel ? csmGetParameterValues(m_coreModel.get()) : nullptr;
+		}
+
+		const float* ModelInstance::getParameterMinValues() const {
+			return m_coreModel ? csmGetParameterMinimumValues(m_coreModel.get()) : nullptr;
+		}
+
+		const float* ModelInstance::getParameterMaxValues() const {
+			return m_coreModel ? csmGetParameterMaximumValues(m_coreModel.get()) : nullptr;
+		}
+
+		const float* ModelInstance::getParameterDefaultValues() const {
+			return m_coreModel ? csmGetParameterDefaultValues(m_coreModel.get()) : nullptr;
+		}
+
+		size_t ModelInstance::getPartCount() const {
+			return m_coreModel ? size_t(csmGetPartCount(m_coreModel.get())) : 0;
+		}
+
+		float* ModelInstance::getPartOpacities() {
+			return m_coreModel ? csmGetPartOpacities(m_coreModel.get()) : nullptr;
+		}
+
+		const float* ModelInstance::getPartOpacities() const {
+			return m_coreModel ? csmGetPartOpacities(m_coreModel.get()) : nullptr;
 		}
 
 		void ModelInstance::initializeDrawables() {
@@ -135,6 +213,7 @@ namespace luna {
 
 			int drawableCount = csmGetDrawableCount(m_coreModel.get());
 			m_drawables.reserve(drawableCount);
+			m_coreDrawableIndices.reserve(drawableCount);
 
 			const int* textureIndices = csmGetDrawableTextureIndices(m_coreModel.get());
 			const int* vertexCounts = csmGetDrawableVertexCounts(m_coreModel.get());
@@ -181,6 +260,7 @@ namespace luna {
 					&m_model->getMaterials()[textureIndices[i]],
 					&m_model->getTextures()[textureIndices[i]]
 				);
+				m_coreDrawableIndices.push_back(uint32_t(i));
 			}
 		}
 
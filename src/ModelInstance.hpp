@@ -3,6 +3,7 @@
 #include <luna.hpp>
 
 #include "Model.hpp"
+#include "MotionStack.hpp"
 #include "Renderer.hpp"
 #include "Parameter.hpp"
 
@@ -16,6 +17,10 @@ namespace luna {
 		 * @brief An instance of the Live2D model. This class provides access to the model's
 		 * parameters and drawables. A Renderer also requires a ModelInstance to render the
 		 * model.
+		 *
+		 * The physics controller, the motion stack, renderers and physics batches all point back at
+		 * the instance, so it can't be copied or moved. Keep instances in a std::unique_ptr or a
+		 * container that doesn't relocate its elements.
 		*/
 		class ModelInstance {
 		public:
@@ -24,9 +29,11 @@ namespace luna {
 			 * throughout the lifespan of this instance.
 			*/
 			explicit ModelInstance(Model* model = nullptr);
+			ModelInstance(const ModelInstance&) = delete;
+			ModelInstance& operator=(const ModelInstance&) = delete;
 
 			/**
-			 * @brief Update the physics, parameters, and vertices of this model.
+			 * @brief Update the motion, physics, parameters, and vertices of this model.
 			 * @param deltatime Duration of the previous frame
 			*/
 			void update(float deltatime);
@@ -37,6 +44,23 @@ namespace luna {
 			PhysicsController* getPhysicsController();
 			const PhysicsController* getPhysicsController() const;
 
+			/**
+			 * @brief The motion layers of this instance. The motion data lives on the Model, the stack only holds the
+			 * time and a cursor per curve of the motions it is playing.
+			*/
+			MotionStack* getMotionStack();
+			const MotionStack* getMotionStack() const;
+
+			/**
+			 * @brief Starts playing one of the motions listed in the .model3.json file, fading from whatever the layer
+			 * was playing with the fade times of the model file, or of the motion if the model file has none
+			 * @param group The name of the motion group, like "Idle"
+			 * @param index The index of the motion in the group
+			 * @param layer The layer of the MotionStack to play it on
+			 * @return False if the model has no such motion
+			*/
+			bool playMotion(const char* group, size_t index = 0, size_t layer = 0);
+
 			void setTransform(const Transform& transform);
 			const Transform& getTransform() const;
 			Transform& getTransform();
@@ -50,12 +74,48 @@ namespace luna {
 			const Drawable* getDrawables() const;
 			const Drawable* getDrawable(const char* id) const;
 			Drawable* getDrawable(const char* id);
+			const Drawable* getDrawable(DrawableHandle handle) const;
+			Drawable* getDrawable(DrawableHandle handle);
+
+			/**
+			 * @brief The dynamic flags of every drawable of the underlying csmModel as a single contiguous array,
+			 * see csmGetDrawableDynamicFlags. Drawables with an invalid texture have no Drawable, so the array is
+			 * indexed with getCoreDrawableIndex.
+			 * @return The dynamic flags, getCoreDrawableCount() of them
+			*/
+			const csmFlags* getDynamicFlags() const;
+			size_t getCoreDrawableCount() const;
+
+			/**
+			 * @param drawableIdx The index of a Drawable in getDrawables()
+			 * @return The index of the drawable in the arrays of the csmModel
+			*/
+			size_t getCoreDrawableIndex(size_t drawableIdx) const;
 
 			size_t getParameterCount() const;
 			Parameter* getParameters();
 			const Parameter* getParameters() const;
 			const Parameter* getParameter(const char* id) const;
 			Parameter* getParameter(const char* id);
+			const Parameter* getParameter(ParameterHandle handle) const;
+			Parameter* getParameter(ParameterHandle handle);
+
+			/**
+			 * @brief The parameter arrays of the underlying csmModel, indexed like getParameters(). Writing to the
+			 * values directly skips the clamping of Parameter::setValue.
+			*/
+			float* getParameterValues();
+			const float* getParameterValues() const;
+			const float* getParameterMinValues() const;
+			const float* getParameterMaxValues() const;
+			const float* getParameterDefaultValues() const;
+
+			/**
+			 * @brief The opacities of the parts of the underlying csmModel, indexed like Model::getPartIndex()
+			*/
+			size_t getPartCount() const;
+			float* getPartOpacities();
+			const float* getPartOpacities() const;
 
 		private:
 			void initializeDrawables();
@@ -66,6 +126,7 @@ namespace luna {
 			Model* m_model;
 
 			std::unique_ptr<PhysicsController> m_physicsController;
+			MotionStack m_motionStack;
 
 			luna::Transform m_transform;
 
@@ -74,6 +135,7 @@ namespace luna {
 			float m_pixelsPerUnit = 0.0f;
 
 			std::vector<Drawable> m_drawables;
+			std::vector<uint32_t> m_coreDrawableIndices;
 			std::vector<Parameter> m_parameters;
 		};
 
@@ -0,0 +1,635 @@
+#include "Motion.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <luna.hpp>
+#include <nlohmann/json.hpp>
+
+#include "Model.hpp"
+#include "ModelInstance.hpp"
+#include "Simd.hpp"
+
+using json = nlohmann::json;
+
+namespace luna {
+	namespace live2d {
+
+		namespace {
+			constexpr float Epsilon = 0.0001f;
+
+			float lerp(float a, float b, float t) {
+				return a + (b - a) * t;
+			}
+
+			simd::Float lerp(simd::Float a, simd::Float b, simd::Float t) {
+				return a + (b - a) * t;
+			}
+
+			// the same as std::max(t, 0.0f) in evaluateSegment
+			simd::Float clampToStart(simd::Float t) {
+				simd::Float zero = simd::set(0.0f);
+				return simd::select(t < zero, zero, t);
+			}
+
+			float solveQuadratic(float a, float b, float c) {
+				if (std::abs(a) < Epsilon) {
+					if (std::abs(b) < Epsilon)
+						return -c;
+					return -c / b;
+				}
+
+				return -(b + sqrtf(b * b - 4.0f * a * c)) / (2.0f * a);
+			}
+
+			// finds the root of a * t^3 + b * t^2 + c * t + d that lies in [0, 1], which is how the Cubism SDK
+			// finds the bezier parameter at a given time when the control points are not restricted
+			float solveCubic(float a, float b, float c, float d) {
+				if (std::abs(a) < Epsilon)
+					return std::clamp(solveQuadratic(b, c, d), 0.0f, 1.0f);
+
+				float ba = b / a;
+				float ca = c / a;
+				float da = d / a;
+
+				float p = (3.0f * ca - ba * ba) / 3.0f;
+				float p3 = p / 3.0f;
+				float q = (2.0f * ba * ba * ba - 9.0f * ba * ca + 27.0f * da) / 27.0f;
+				float q2 = q / 2.0f;
+				float discriminant = q2 * q2 + p3 * p3 * p3;
+
+				constexpr float center = 0.5f;
+				constexpr float threshold = center + 0.01f;
+
+				if (discriminant < 0.0f) {
+					float mp3 = -p / 3.0f;
+					float r = sqrtf(mp3 * mp3 * mp3);
+					float phi = acosf(std::clamp(-q / (2.0f * r), -1.0f, 1.0f));
+					float t1 = 2.0f * cbrtf(r);
+
+					float root1 = t1 * cosf(phi / 3.0f) - ba / 3.0f;
+					if (std::abs(root1 - center) < threshold)
+						return std::clamp(root1, 0.0f, 1.0f);
+
+					float root2 = t1 * cosf((phi + luna::Tau) / 3.0f) - ba / 3.0f;
+					if (std::abs(root2 - center) < threshold)
+						return std::clamp(root2, 0.0f, 1.0f);
+
+					float root3 = t1 * cosf((phi + 2.0f * luna::Tau) / 3.0f) - ba / 3.0f;
+					return std::clamp(root3, 0.0f, 1.0f);
+				}
+
+				if (discriminant == 0.0f) {
+					float u1 = q2 < 0.0f ? cbrtf(-q2) : -cbrtf(q2);
+
+					float root1 = 2.0f * u1 - ba / 3.0f;
+					if (std::abs(root1 - center) < threshold)
+						return std::clamp(root1, 0.0f, 1.0f);
+
+					return std::clamp(-u1 - ba / 3.0f, 0.0f, 1.0f);
+				}
+
+				float sd = sqrtf(discriminant);
+				return std::clamp(cbrtf(sd - q2) - cbrtf(sd + q2) - ba / 3.0f, 0.0f, 1.0f);
+			}
+
+			void writeValue(const MotionCurve& curve, float value, ModelInstance& instance, float* partOpacities, size_t partCount) {
+				if (curve.target == MotionTarget::Parameter) {
+					if (Parameter* parameter = instance.getParameter(ParameterHandle{ curve.targetIndex }))
+						parameter->setValue(value);
+				} else if (curve.target == MotionTarget::PartOpacity && curve.targetIndex < partCount) {
+					partOpacities[curve.targetIndex] = value;
+				}
+			}
+		}
+
+		Motion::Motion(const char* filepath) {
+			load(filepath);
+		}
+
+		void Motion::load(const char* filepath) {
+			std::ifstream file(filepath);
+			if (file.bad() || file.fail() || file.eof()) {
+				log("Could not open file at \"" + std::string(filepath) + "\"", MessageSeverity::Error);
+				return;
+			}
+			json motionFile = json::parse(file);
+
+			auto& meta = motionFile.at("Meta");
+			m_duration = meta.at("Duration");
+			m_fps = meta.value("Fps", 0.0f);
+			m_loop = meta.value("Loop", false);
+			m_beziersRestricted = meta.value("AreBeziersRestricted", false);
+			m_fadeInTime = meta.value("FadeInTime", 1.0f);
+			m_fadeOutTime = meta.value("FadeOutTime", 1.0f);
+
+			// the counts in the meta are only used to size the tables up front
+			m_curves.reserve(meta.value("CurveCount", size_t(0)));
+			m_segmentEnds.reserve(meta.value("TotalSegmentCount", size_t(0)));
+			m_segmentPoints.reserve(meta.value("TotalSegmentCount", size_t(0)));
+			m_segmentTypes.reserve(meta.value("TotalSegmentCount", size_t(0)));
+			m_pointTimes.reserve(meta.value("TotalPointCount", size_t(0)));
+			m_pointValues.reserve(meta.value("TotalPointCount", size_t(0)));
+
+			for (auto& curveData : motionFile.at("Curves")) {
+				MotionCurve curve;
+				curve.id = curveData.at("Id");
+
+				std::string target = curveData.at("Target");
+				curve.target = target == "Parameter" ? MotionTarget::Parameter : (target == "PartOpacity" ? MotionTarget::PartOpacity : MotionTarget::Model);
+				curve.fadeInTime = curveData.value("FadeInTime", -1.0f);
+				curve.fadeOutTime = curveData.value("FadeOutTime", -1.0f);
+
+				auto& segments = curveData.at("Segments");
+				if (segments.size() < 2) {
+					log("Motion curve \"" + curve.id + "\" has no points", MessageSeverity::Warning);
+					continue;
+				}
+
+				curve.firstSegment = uint32_t(m_segmentEnds.size());
+				curve.firstPoint = uint32_t(m_pointTimes.size());
+
+				// the segments start with the first point, after that every segment is its type followed by its points,
+				// the first point of a segment is the last point of the one before it
+				m_pointTimes.push_back(segments[0]);
+				m_pointValues.push_back(segments[1]);
+
+				size_t i = 2;
+				while (i < segments.size()) {
+					int type = segments[i];
+					size_t pointCount = type == int(MotionSegmentType::Bezier) ? 3 : 1;
+					if (type < 0 || type > int(MotionSegmentType::InverseStepped) || i + 1 + pointCount * 2 > segments.size()) {
+						log("Motion curve \"" + curve.id + "\" has an invalid segment", MessageSeverity::Warning);
+						break;
+					}
+
+					m_segmentPoints.push_back(uint32_t(m_pointTimes.size() - 1));
+					m_segmentTypes.push_back(MotionSegmentType(type));
+
+					for (size_t p = 0; p < pointCount; ++p) {
+						m_pointTimes.push_back(segments[i + 1 + p * 2]);
+						m_pointValues.push_back(segments[i + 2 + p * 2]);
+					}
+					m_segmentEnds.push_back(m_pointTimes.back());
+
+					i += 1 + pointCount * 2;
+				}
+
+				curve.segmentCount = uint32_t(m_segmentEnds.size()) - curve.firstSegment;
+				m_curves.push_back(std::move(curve));
+			}
+
+			m_valid = true;
+		}
+
+		void Motion::bindTo(const Model& model) {
+			for (auto& curve : m_curves) {
+				curve.targetIndex = uint32_t(-1);
+
+				if (curve.target == MotionTarget::Parameter) {
+					curve.targetIndex = model.getParameterHandle(curve.id.c_str()).index;
+				} else if (curve.target == MotionTarget::PartOpacity) {
+					size_t index = model.getPartIndex().find(curve.id.c_str());
+					if (index != IdIndex::npos)
+						curve.targetIndex = uint32_t(index);
+				}
+			}
+		}
+
+		bool Motion::isValid() const {
+			return m_valid;
+		}
+
+		float Motion::getDuration() const {
+			return m_duration;
+		}
+
+		float Motion::getFps() const {
+			return m_fps;
+		}
+
+		bool Motion::isLooping() const {
+			return m_loop;
+		}
+
+		bool Motion::areBeziersRestricted() const {
+			return m_beziersRestricted;
+		}
+
+		float Motion::getFadeInTime() const {
+			return m_fadeInTime;
+		}
+
+		float Motion::getFadeOutTime() const {
+			return m_fadeOutTime;
+		}
+
+		size_t Motion::getCurveCount() const {
+			return m_curves.size();
+		}
+
+		const MotionCurve* Motion::getCurves() const {
+			return m_curves.data();
+		}
+
+		size_t Motion::getSegmentCount() const {
+			return m_segmentEnds.size();
+		}
+
+		size_t Motion::getPointCount() const {
+			return m_pointTimes.size();
+		}
+
+		float Motion::evaluate(size_t curveIdx, float time) const {
+			const MotionCurve& curve = m_curves[curveIdx];
+			if (curve.bakedColumn != uint32_t(-1))
+				return evaluateBaked(curveIdx, time);
+			if (curve.segmentCount == 0)
+				return m_pointValues[curve.firstPoint];
+
+			// the segment at time is the first one that ends after it
+			auto begin = m_segmentEnds.begin() + curve.firstSegment;
+			auto end = begin + curve.segmentCount;
+			auto segment = std::upper_bound(begin, end, time);
+			if (segment == end)
+				return getEndValue(curve.firstSegment + curve.segmentCount - 1);
+
+			return evaluateSegment(uint32_t(segment - m_segmentEnds.begin()), time);
+		}
+
+		float Motion::evaluate(size_t curveIdx, float time, uint32_t& cursor) const {
+			const MotionCurve& curve = m_curves[curveIdx];
+			if (curve.bakedColumn != uint32_t(-1))
+				return evaluateBaked(curveIdx, time);
+			if (curve.segmentCount == 0)
+				return m_pointValues[curve.firstPoint];
+
+			uint32_t first = curve.firstSegment;
+			uint32_t last = first + curve.segmentCount - 1;
+			if (cursor < first || cursor > last)
+				cursor = first;
+
+			// walk to the first segment that ends after time, usually this is the segment we're already at
+			while (cursor < last && m_segmentEnds[cursor] <= time)
+				++cursor;
+			while (cursor > first && m_segmentEnds[cursor - 1] > time)
+				--cursor;
+
+			// past the end the curve holds its last value
+			if (m_segmentEnds[cursor] <= time)
+				return getEndValue(cursor);
+
+			return evaluateSegment(cursor, time);
+		}
+
+		void Motion::sample(const float* times, size_t count, float* values) const {
+			for (size_t c = 0; c < m_curves.size(); ++c) {
+				const MotionCurve& curve = m_curves[c];
+				float* curveValues = values + c * count;
+
+				if (curve.bakedColumn != uint32_t(-1)) {
+					for (size_t i = 0; i < count; ++i)
+						curveValues[i] = evaluateBaked(c, times[i]);
+					continue;
+				}
+
+				if (curve.segmentCount == 0) {
+					std::fill(curveValues, curveValues + count, m_pointValues[curve.firstPoint]);
+					continue;
+				}
+
+				uint32_t first = curve.firstSegment;
+				uint32_t last = first + curve.segmentCount - 1;
+				uint32_t cursor = first;
+
+				for (size_t i = 0; i < count;) {
+					float time = times[i];
+					if (i > 0 && time < times[i - 1]) {
+						// only the first segment that ends after time is searched for, so the last one doubles as the end
+						cursor = uint32_t(std::upper_bound(m_segmentEnds.begin() + first, m_segmentEnds.begin() + last, time) - m_segmentEnds.begin());
+					} else {
+						while (cursor < last && m_segmentEnds[cursor] <= time)
+							++cursor;
+					}
+
+					float segmentEnd = m_segmentEnds[cursor];
+					if (segmentEnd <= time) {
+						curveValues[i++] = getEndValue(cursor);
+						continue;
+					}
+
+					// the sorted times that follow and still fall in this segment are evaluated in one go
+					size_t runEnd = i + 1;
+					while (runEnd < count && times[runEnd] < segmentEnd && times[runEnd] >= times[runEnd - 1])
+						++runEnd;
+
+					sampleSegment(cursor, times + i, runEnd - i, curveValues + i);
+					i = runEnd;
+				}
+			}
+		}
+
+		void Motion::sampleSegment(uint32_t segmentIdx, const float* times, size_t count, float* values) const {
+			uint32_t p = m_segmentPoints[segmentIdx];
+			const float* pointTimes = &m_pointTimes[p];
+			const float* pointValues = &m_pointValues[p];
+			size_t i = 0;
+
+			switch (m_segmentTypes[segmentIdx]) {
+			case MotionSegmentType::Linear: {
+				simd::Float start = simd::set(pointTimes[0]);
+				simd::Float length = simd::set(pointTimes[1] - pointTimes[0]);
+				simd::Float v0 = simd::set(pointValues[0]);
+				simd::Float v1 = simd::set(pointValues[1]);
+
+				for (; i + simd::Width <= count; i += simd::Width) {
+					simd::Float t = clampToStart((simd::load(times + i) - start) / length);
+					simd::store(values + i, lerp(v0, v1, t));
+				}
+				break;
+			}
+			case MotionSegmentType::Bezier: {
+				// an unrestricted bezier needs a cubic solve per time, that stays scalar
+				if (!m_beziersRestricted)
+					break;
+
+				simd::Float start = simd::set(pointTimes[0]);
+				simd::Float length = simd::set(pointTimes[3] - pointTimes[0]);
+				simd::Float v0 = simd::set(pointValues[0]);
+				simd::Float v1 = simd::set(pointValues[1]);
+				simd::Float v2 = simd::set(pointValues[2]);
+				simd::Float v3 = simd::set(pointValues[3]);
+
+				for (; i + simd::Width <= count; i += simd::Width) {
+					simd::Float t = clampToStart((simd::load(times + i) - start) / length);
+					simd::Float p01 = lerp(v0, v1, t);
+					simd::Float p12 = lerp(v1, v2, t);
+					simd::Float p23 = lerp(v2, v3, t);
+					simd::store(values + i, lerp(lerp(p01, p12, t), lerp(p12, p23, t), t));
+				}
+				break;
+			}
+			case MotionSegmentType::Stepped:
+			case MotionSegmentType::InverseStepped:
+				std::fill(values, values + count, evaluateSegment(segmentIdx, times[0]));
+				return;
+			}
+
+			// whatever is left over after the full registers
+			for (; i < count; ++i)
+				values[i] = evaluateSegment(segmentIdx, times[i]);
+		}
+
+		MotionBakeStats Motion::bake(float rate) {
+			clearBake();
+			if (rate <= 0.0f)
+				rate = m_fps > 0.0f ? m_fps : 30.0f;
+
+			// the frames are spread evenly over the duration, so the last one lands exactly on the end
+			size_t curveCount = m_curves.size();
+			size_t frameCount = std::max(size_t(std::ceil(m_duration * rate)) + 1, size_t(2));
+			float framesPerSecond = m_duration > 0.0f ? float(frameCount - 1) / m_duration : rate;
+
+			std::vector<float> times(frameCount);
+			for (size_t f = 0; f < frameCount; ++f)
+				times[f] = float(f) / framesPerSecond;
+
+			// probe the exact curves before the baked tables take over
+			constexpr size_t probesPerFrame = 4;
+			std::vector<float> probeTimes((frameCount - 1) * probesPerFrame);
+			for (size_t i = 0; i < probeTimes.size(); ++i)
+				probeTimes[i] = float(i) / (framesPerSecond * float(probesPerFrame));
+
+			std::vector<float> exact(curveCount * frameCount);
+			std::vector<float> probes(curveCount * probeTimes.size());
+			sample(times.data(), frameCount, exact.data());
+			sample(probeTimes.data(), probeTimes.size(), probes.data());
+
+			// a lerp between two samples turns a step into a ramp, so curves with stepped segments stay exact
+			size_t columnCount = 0;
+			for (auto& curve : m_curves) {
+				bool stepped = false;
+				for (uint32_t s = curve.firstSegment; s < curve.firstSegment + curve.segmentCount; ++s)
+					stepped |= m_segmentTypes[s] == MotionSegmentType::Stepped || m_segmentTypes[s] == MotionSegmentType::InverseStepped;
+				curve.bakedColumn = stepped ? uint32_t(-1) : uint32_t(columnCount++);
+			}
+
+			m_bakeStats.exactCurveCount = curveCount - columnCount;
+			m_bakeStats.curveBytes = m_segmentEnds.size() * (sizeof(float) + sizeof(uint32_t) + sizeof(MotionSegmentType)) + m_pointTimes.size() * 2 * sizeof(float);
+			if (columnCount == 0)
+				return m_bakeStats;
+
+			// quantize every baked curve to the range it covers
+			m_bakedSamples.resize(frameCount * columnCount);
+			m_bakedOffsets.resize(columnCount);
+			m_bakedScales.resize(columnCount);
+			for (size_t c = 0; c < curveCount; ++c) {
+				uint32_t column = m_curves[c].bakedColumn;
+				if (column == uint32_t(-1))
+					continue;
+
+				const float* curveValues = &exact[c * frameCount];
+				auto [minValue, maxValue] = std::minmax_element(curveValues, curveValues + frameCount);
+				float scale = (*maxValue - *minValue) / 65535.0f;
+
+				m_bakedOffsets[column] = *minValue;
+				m_bakedScales[column] = scale;
+				for (size_t f = 0; f < frameCount; ++f)
+					m_bakedSamples[f * columnCount + column] = scale > 0.0f ? uint16_t(std::lround((curveValues[f] - *minValue) / scale)) : 0;
+			}
+			m_bakedFramesPerSecond = framesPerSecond;
+
+			m_bakeStats.rate = framesPerSecond;
+			m_bakeStats.frameCount = frameCount;
+			m_bakeStats.bakedBytes = m_bakedSamples.size() * sizeof(uint16_t) + columnCount * 2 * sizeof(float);
+			for (size_t c = 0; c < curveCount; ++c) {
+				if (m_curves[c].bakedColumn == uint32_t(-1))
+					continue;
+				for (size_t i = 0; i < probeTimes.size(); ++i)
+					m_bakeStats.maxError = std::max(m_bakeStats.maxError, std::abs(evaluateBaked(c, probeTimes[i]) - probes[c * probeTimes.size() + i]));
+			}
+
+			return m_bakeStats;
+		}
+
+		void Motion::clearBake() {
+			for (auto& curve : m_curves)
+				curve.bakedColumn = uint32_t(-1);
+			m_bakedSamples.clear();
+			m_bakedOffsets.clear();
+			m_bakedScales.clear();
+			m_bakedFramesPerSecond = 0.0f;
+			m_bakeStats = {};
+		}
+
+		bool Motion::isBaked() const {
+			return !m_bakedSamples.empty();
+		}
+
+		const MotionBakeStats& Motion::getBakeStats() const {
+			return m_bakeStats;
+		}
+
+		void Motion::apply(ModelInstance& instance, const float* values, size_t stride) const {
+			float* partOpacities = instance.getPartOpacities();
+			size_t partCount = instance.getPartCount();
+
+			for (size_t c = 0; c < m_curves.size(); ++c) {
+				if (m_curves[c].targetIndex != uint32_t(-1))
+					writeValue(m_curves[c], values[c * stride], instance, partOpacities, partCount);
+			}
+		}
+
+		float Motion::evaluateBaked(size_t curveIdx, float time) const {
+			size_t columnCount = m_bakedOffsets.size();
+			size_t column = m_curves[curveIdx].bakedColumn;
+			size_t lastFrame = m_bakedSamples.size() / columnCount - 1;
+
+			float frame = std::clamp(time * m_bakedFramesPerSecond, 0.0f, float(lastFrame));
+			size_t f = std::min(size_t(frame), lastFrame - 1);
+			float t = frame - float(f);
+
+			float a = float(m_bakedSamples[f * columnCount + column]);
+			float b = float(m_bakedSamples[(f + 1) * columnCount + column]);
+			return m_bakedOffsets[column] + lerp(a, b, t) * m_bakedScales[column];
+		}
+
+		float Motion::getEndValue(uint32_t segmentIdx) const {
+			return m_pointValues[m_segmentPoints[segmentIdx] + (m_segmentTypes[segmentIdx] == MotionSegmentType::Bezier ? 3 : 1)];
+		}
+
+		float Motion::evaluateSegment(uint32_t segmentIdx, float time) const {
+			uint32_t p = m_segmentPoints[segmentIdx];
+
+			switch (m_segmentTypes[segmentIdx]) {
+			case MotionSegmentType::Linear: {
+				float t = std::max((time - m_pointTimes[p]) / (m_pointTimes[p + 1] - m_pointTimes[p]), 0.0f);
+				return lerp(m_pointValues[p], m_pointValues[p + 1], t);
+			}
+			case MotionSegmentType::Bezier:
+				return evaluateBezier(p, time);
+			case MotionSegmentType::Stepped:
+				return m_pointValues[p];
+			case MotionSegmentType::InverseStepped:
+				return m_pointValues[p + 1];
+			}
+
+			return m_pointValues[p];
+		}
+
+		float Motion::evaluateBezier(uint32_t p, float time) const {
+			const float* times = &m_pointTimes[p];
+			const float* values = &m_pointValues[p];
+
+			float t;
+			if (m_beziersRestricted) {
+				// the control points are spaced evenly in time, so the bezier parameter is linear in time
+				t = std::max((time - times[0]) / (times[3] - times[0]), 0.0f);
+			} else {
+				float a = times[3] - 3.0f * times[2] + 3.0f * times[1] - times[0];
+				float b = 3.0f * times[2] - 6.0f * times[1] + 3.0f * times[0];
+				float c = 3.0f * times[1] - 3.0f * times[0];
+				t = solveCubic(a, b, c, times[0] - time);
+			}
+
+			// de casteljau
+			float p01 = lerp(values[0], values[1], t);
+			float p12 = lerp(values[1], values[2], t);
+			float p23 = lerp(values[2], values[3], t);
+			float p012 = lerp(p01, p12, t);
+			float p123 = lerp(p12, p23, t);
+			return lerp(p012, p123, t);
+		}
+
+		MotionPlayer::MotionPlayer(const Motion* motion) {
+			play(motion);
+		}
+
+		void MotionPlayer::attachTo(ModelInstance* instance) {
+			m_instance = instance;
+		}
+
+		void MotionPlayer::play(const Motion* motion) {
+			m_motion = motion;
+			m_time = 0.0f;
+			m_looping = motion && motion->isLooping();
+			resetCursors();
+		}
+
+		const Motion* MotionPlayer::getMotion() const {
+			return m_motion;
+		}
+
+		void MotionPlayer::update(float deltatime) {
+			if (!m_motion)
+				return;
+
+			advance(deltatime);
+			apply();
+		}
+
+		void MotionPlayer::advance(float deltatime) {
+			if (!m_motion)
+				return;
+
+			m_time += deltatime;
+			if (m_looping && m_motion->getDuration() > 0.0f && m_time >= m_motion->getDuration()) {
+				// the cursors would walk back one segment at a time, starting over is cheaper
+				m_time = fmodf(m_time, m_motion->getDuration());
+				resetCursors();
+			}
+		}
+
+		float MotionPlayer::evaluate(size_t curveIdx) {
+			return m_motion->evaluate(curveIdx, m_time, m_cursors[curveIdx]);
+		}
+
+		void MotionPlayer::apply() {
+			if (!m_motion || !m_instance)
+				return;
+
+			const MotionCurve* curves = m_motion->getCurves();
+			float* partOpacities = m_instance->getPartOpacities();
+			size_t partCount = m_instance->getPartCount();
+
+			for (size_t i = 0; i < m_motion->getCurveCount(); ++i) {
+				const MotionCurve& curve = curves[i];
+				if (curve.targetIndex == uint32_t(-1))
+					continue;
+
+				writeValue(curve, evaluate(i), *m_instance, partOpacities, partCount);
+			}
+		}
+
+		void MotionPlayer::seek(float time) {
+			m_time = time;
+		}
+
+		float MotionPlayer::getTime() const {
+			return m_time;
+		}
+
+		void MotionPlayer::setLooping(bool looping) {
+			m_looping = looping;
+		}
+
+		bool MotionPlayer::isLooping() const {
+			return m_looping;
+		}
+
+		bool MotionPlayer::isFinished() const {
+			return !m_motion || (!m_looping && m_time >= m_motion->getDuration());
+		}
+
+		void MotionPlayer::resetCursors() {
+			m_cursors.clear();
+			if (!m_motion)
+				return;
+
+			m_cursors.reserve(m_motion->getCurveCount());
+			for (size_t i = 0; i < m_motion->getCurveCount(); ++i)
+				m_cursors.push_back(m_motion->getCurves()[i].firstSegment);
+		}
+
+	}
+}
@@ -0,0 +1,317 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace luna {
+	namespace live2d {
+
+		class Model;
+		class ModelInstance;
+
+		/**
+		 * @brief What a MotionCurve animates
+		*/
+		enum class MotionTarget : uint8_t {
+			Parameter, PartOpacity, Model
+		};
+
+		/**
+		 * @brief The segment types of a .motion3.json curve, the values match the ones in the file
+		*/
+		enum class MotionSegmentType : uint8_t {
+			Linear = 0,
+			Bezier = 1,
+			Stepped = 2,
+			InverseStepped = 3,
+		};
+
+		/**
+		 * @brief A single curve of a Motion. The keyframes of the curve live in the tables of the Motion,
+		 * the curve only knows where its range starts.
+		*/
+		struct MotionCurve {
+			std::string id;
+			MotionTarget target;
+
+			/**
+			 * @brief The index of the parameter or part this curve animates, resolved by Motion::bindTo.
+			 * It is uint32_t(-1) when the model has no such parameter or part.
+			*/
+			uint32_t targetIndex = uint32_t(-1);
+
+			/**
+			 * @brief The fade times of this curve, negative when the curve uses the fade times of the Motion
+			*/
+			float fadeInTime = -1.0f;
+			float fadeOutTime = -1.0f;
+
+			uint32_t firstSegment = 0;
+			uint32_t segmentCount = 0;
+			uint32_t firstPoint = 0;
+
+			/**
+			 * @brief The column of this curve in the baked tables of the Motion, uint32_t(-1) while the curve is evaluated
+			 * exactly. Curves with stepped segments are never baked, see Motion::bake.
+			*/
+			uint32_t bakedColumn = uint32_t(-1);
+		};
+
+		/**
+		 * @brief What baking a Motion cost and how close the baked curves stay to the exact ones, see Motion::bake
+		*/
+		struct MotionBakeStats {
+			float rate = 0.0f;
+			size_t frameCount = 0;
+
+			/**
+			 * @brief The size of the baked tables and of the compiled curve tables, in bytes
+			*/
+			size_t bakedBytes = 0;
+			size_t curveBytes = 0;
+
+			/**
+			 * @brief The largest difference between the baked and the exact curves, probed at four points per sample interval
+			*/
+			float maxError = 0.0f;
+
+			/**
+			 * @brief The curves that were left exact because they contain stepped segments
+			*/
+			size_t exactCurveCount = 0;
+		};
+
+		/**
+		 * @brief A motion loaded from a .motion3.json file. The flat segment arrays of the file are compiled into
+		 * structure-of-arrays tables: every segment has a type, an end time and the index of its first point, and
+		 * neighbouring segments share the point where one ends and the next one starts. A Motion is read-only
+		 * once it is loaded, the playback state lives in a MotionPlayer.
+		*/
+		class Motion {
+		public:
+			Motion() = default;
+
+			/**
+			 * @param filepath The path to the .motion3.json file
+			*/
+			explicit Motion(const char* filepath);
+
+			/**
+			 * @brief Resolves the parameter and part ids of all the curves to indices of the given Model
+			 * @param model The Model this motion will be played on
+			*/
+			void bindTo(const Model& model);
+
+			bool isValid() const;
+
+			float getDuration() const;
+			float getFps() const;
+			bool isLooping() const;
+			bool areBeziersRestricted() const;
+
+			/**
+			 * @return The fade times of the whole motion, 1 second when the file does not specify them
+			*/
+			float getFadeInTime() const;
+			float getFadeOutTime() const;
+
+			size_t getCurveCount() const;
+			const MotionCurve* getCurves() const;
+
+			size_t getSegmentCount() const;
+			size_t getPointCount() const;
+
+			/**
+			 * @brief Evaluates a curve by searching for the segment at the given time
+			 * @param curveIdx The index of the curve
+			 * @param time The time in seconds, times outside of the curve hold the first or last value
+			 * @return The value of the curve
+			*/
+			float evaluate(size_t curveIdx, float time) const;
+
+			/**
+			 * @brief Evaluates a curve starting from the segment that was used last time. When the time only moves a
+			 * little between calls this finds the segment in one or two steps, no matter how long the curve is.
+			 * @param curveIdx The index of the curve
+			 * @param time The time in seconds
+			 * @param cursor The segment the last evaluation of this curve ended up at, it is updated to the segment at time
+			 * @return The value of the curve
+			*/
+			float evaluate(size_t curveIdx, float time, uint32_t& cursor) const;
+
+			/**
+			 * @brief Resamples every curve at a fixed rate into 16 bit tables, one row of samples per frame. From then on
+			 * evaluating the motion is a lerp between two samples, which is much cheaper than solving an unrestricted bezier.
+			 * Curves with stepped or inverse stepped segments are left exact, a lerp would turn their steps into ramps.
+			 * Sharp turns still get smoothed over one sample interval, check the error in the stats.
+			 * @param rate The samples per second, 0 uses the Fps of the motion (30 when the file does not specify it)
+			 * @return The memory cost and the error of the baked tables
+			*/
+			MotionBakeStats bake(float rate = 0.0f);
+
+			/**
+			 * @brief Drops the baked tables, evaluating the motion goes back to the exact curves
+			*/
+			void clearBake();
+
+			/**
+			 * @return True when at least one curve is evaluated from the baked tables
+			*/
+			bool isBaked() const;
+			const MotionBakeStats& getBakeStats() const;
+
+			/**
+			 * @brief Evaluates every curve at a batch of times, for instance the times of a crowd of instances that all
+			 * play this motion. The tables of a curve are walked once for the whole batch with a single cursor, so when
+			 * the times are sorted every sample only costs a step or two. Unsorted times still work, a step back costs a
+			 * binary search. A run of sorted times that falls in one linear or restricted bezier segment is evaluated
+			 * with SIMD instructions (AVX, SSE2 or NEON), unrestricted beziers still solve a cubic for every time.
+			 * @param times The times in seconds
+			 * @param count The amount of times
+			 * @param values Receives getCurveCount() * count values, the value of curve c at times[i] is at values[c * count + i]
+			*/
+			void sample(const float* times, size_t count, float* values) const;
+
+			/**
+			 * @brief Writes values of the curves to the parameters and part opacities of an instance
+			 * @param instance An instance of the Model this motion is bound to
+			 * @param values The value of curve c is at values[c * stride]
+			 * @param stride The distance between the values of two curves, use the count passed to sample() to apply one of its columns
+			*/
+			void apply(ModelInstance& instance, const float* values, size_t stride = 1) const;
+
+		private:
+			void load(const char* filepath);
+			float getEndValue(uint32_t segmentIdx) const;
+			float evaluateSegment(uint32_t segmentIdx, float time) const;
+			float evaluateBezier(uint32_t pointIdx, float time) const;
+			float evaluateBaked(size_t curveIdx, float time) const;
+			void sampleSegment(uint32_t segmentIdx, const float* times, size_t count, float* values) const;
+
+		private:
+			float m_duration = 0.0f;
+			float m_fps = 0.0f;
+			float m_fadeInTime = 1.0f;
+			float m_fadeOutTime = 1.0f;
+			bool m_loop = false;
+			bool m_beziersRestricted = false;
+			bool m_valid = false;
+
+			std::vector<MotionCurve> m_curves;
+
+			// per segment
+			std::vector<float> m_segmentEnds;
+			std::vector<uint32_t> m_segmentPoints;
+			std::vector<MotionSegmentType> m_segmentTypes;
+
+			// per point
+			std::vector<float> m_pointTimes;
+			std::vector<float> m_pointValues;
+
+			// the baked samples of a curve at frame f are at f * m_bakedOffsets.size() + curve.bakedColumn
+			std::vector<uint16_t> m_bakedSamples;
+			std::vector<float> m_bakedOffsets;
+			std::vector<float> m_bakedScales;
+			float m_bakedFramesPerSecond = 0.0f;
+			MotionBakeStats m_bakeStats;
+		};
+
+		/**
+		 * @brief A motion listed in the FileReferences.Motions of a .model3.json file
+		*/
+		struct MotionEntry {
+			const Motion* motion = nullptr;
+
+			/**
+			 * @brief The fade times the model file sets for this motion, negative when it uses the ones of the motion
+			*/
+			float fadeInTime = -1.0f;
+			float fadeOutTime = -1.0f;
+		};
+
+		/**
+		 * @brief A named group of motions, like "Idle" or "TapBody"
+		*/
+		struct MotionGroup {
+			std::string name;
+			std::vector<MotionEntry> motions;
+		};
+
+		/**
+		 * @brief Plays a Motion on a ModelInstance. Next to the time, the player keeps the segment every curve was
+		 * at last frame, so sequential playback only looks at one or two segments per curve. The curves themselves are
+		 * shared, so playing the same Motion on many instances costs one cursor per curve and instance.
+		*/
+		class MotionPlayer {
+		public:
+			/**
+			 * @param motion The motion to play, this pointer has to stay valid for as long as it is played
+			*/
+			explicit MotionPlayer(const Motion* motion = nullptr);
+
+			/**
+			 * @brief Attaches this MotionPlayer to a ModelInstance, update() writes to the parameters and parts of this instance
+			 * @param instance The ModelInstance to animate, it has to be an instance of the Model the motion is bound to
+			*/
+			void attachTo(ModelInstance* instance);
+
+			/**
+			 * @brief Starts playing a motion from the beginning
+			 * @param motion The motion to play, or nullptr to stop playing
+			*/
+			void play(const Motion* motion);
+			const Motion* getMotion() const;
+
+			/**
+			 * @brief Advances the time and writes the values of the motion to the attached ModelInstance
+			*/
+			void update(float deltatime);
+
+			/**
+			 * @brief Advances the time without writing anything, wrapping it around when the motion loops
+			*/
+			void advance(float deltatime);
+
+			/**
+			 * @return The value of a curve of the motion at the current time
+			*/
+			float evaluate(size_t curveIdx);
+
+			/**
+			 * @brief Writes the values of the motion at the current time to the attached ModelInstance
+			*/
+			void apply();
+
+			/**
+			 * @brief Jumps to a time in the motion
+			*/
+			void seek(float time);
+			float getTime() const;
+
+			/**
+			 * @brief Overrides whether the motion loops, by default this is taken from the motion file
+			*/
+			void setLooping(bool looping);
+			bool isLooping() const;
+
+			/**
+			 * @return True when a non-looping motion has played past its end, or when there is no motion
+			*/
+			bool isFinished() const;
+
+		private:
+			void resetCursors();
+
+		private:
+			const Motion* m_motion = nullptr;
+			ModelInstance* m_instance = nullptr;
+
+			float m_time = 0.0f;
+			bool m_looping = false;
+			std::vector<uint32_t> m_cursors;
+		};
+
+	}
+}
@@ -0,0 +1,223 @@
+#include "MotionStack.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <luna.hpp>
+
+#include "ModelInstance.hpp"
+
+namespace luna {
+	namespace live2d {
+
+		namespace {
+			// how far a fade of the given duration is after time, eased in and out like the Cubism SDK does
+			float fade(float time, float duration) {
+				if (duration <= 0.0f)
+					return 1.0f;
+
+				float t = std::clamp(time / duration, 0.0f, 1.0f);
+				return 0.5f - 0.5f * cosf(t * luna::Pi);
+			}
+		}
+
+		MotionStack::MotionStack() {
+			addLayer();
+		}
+
+		void MotionStack::attachTo(ModelInstance* instance) {
+			m_instance = instance;
+			m_blended = false;
+
+			m_parameterCount = instance ? instance->getParameterCount() : 0;
+			size_t partCount = instance ? instance->getPartCount() : 0;
+
+			m_values.assign(m_parameterCount + partCount, 0.0f);
+			m_base.assign(m_parameterCount + partCount, 0.0f);
+			m_written.assign(m_parameterCount + partCount, 0);
+			m_defaults.assign(m_parameterCount + partCount, 1.0f);
+			if (m_parameterCount)
+				std::copy(instance->getParameterDefaultValues(), instance->getParameterDefaultValues() + m_parameterCount, m_defaults.begin());
+		}
+
+		size_t MotionStack::addLayer(MotionBlendMode mode, float weight) {
+			Layer& layer = m_layers.emplace_back();
+			layer.mode = mode;
+			layer.weight = weight;
+			return m_layers.size() - 1;
+		}
+
+		size_t MotionStack::getLayerCount() const {
+			return m_layers.size();
+		}
+
+		void MotionStack::setLayerWeight(size_t layer, float weight) {
+			m_layers[layer].weight = weight;
+		}
+
+		float MotionStack::getLayerWeight(size_t layer) const {
+			return m_layers[layer].weight;
+		}
+
+		void MotionStack::setLayerMode(size_t layer, MotionBlendMode mode) {
+			m_layers[layer].mode = mode;
+		}
+
+		MotionBlendMode MotionStack::getLayerMode(size_t layer) const {
+			return m_layers[layer].mode;
+		}
+
+		void MotionStack::play(size_t layer, const Motion* motion, float fadeInTime, float fadeOutTime) {
+			if (!motion) {
+				stop(layer);
+				return;
+			}
+
+			start(m_layers[layer], motion, fadeInTime, fadeOutTime);
+		}
+
+		void MotionStack::setIdleMotion(size_t layer, const Motion* motion) {
+			m_layers[layer].idleMotion = motion;
+		}
+
+		void MotionStack::stop(size_t layer) {
+			for (auto& track : m_layers[layer].tracks)
+				fadeOut(track);
+		}
+
+		bool MotionStack::isPlaying(size_t layer) const {
+			const auto& tracks = m_layers[layer].tracks;
+			return std::any_of(tracks.begin(), tracks.end(), [](const Track& track) { return !isFadingOut(track); });
+		}
+
+		void MotionStack::update(float deltatime) {
+			if (!m_instance || m_values.empty())
+				return;
+
+			bool hasTracks = false;
+			for (auto& layer : m_layers) {
+				advance(layer, deltatime);
+				hasTracks |= !layer.tracks.empty();
+			}
+
+			// once the last motion is gone, one more pass puts back the values from before the motions
+			if (!hasTracks && !m_blended)
+				return;
+
+			load();
+			for (auto& layer : m_layers) {
+				for (auto& track : layer.tracks)
+					blend(layer, track);
+			}
+			store();
+
+			m_blended = hasTracks;
+		}
+
+		bool MotionStack::isFadingOut(const Track& track) {
+			return track.endTime >= 0.0f && track.elapsed > track.endTime - track.fadeOutTime;
+		}
+
+		void MotionStack::fadeOut(Track& track) {
+			float endTime = track.elapsed + track.fadeOutTime;
+			if (track.endTime < 0.0f || endTime < track.endTime)
+				track.endTime = endTime;
+		}
+
+		void MotionStack::start(Layer& layer, const Motion* motion, float fadeInTime, float fadeOutTime) {
+			for (auto& track : layer.tracks)
+				fadeOut(track);
+
+			Track& track = layer.tracks.emplace_back();
+			track.player.play(motion);
+			track.fadeInTime = fadeInTime < 0.0f ? motion->getFadeInTime() : fadeInTime;
+			track.fadeOutTime = fadeOutTime < 0.0f ? motion->getFadeOutTime() : fadeOutTime;
+
+			// a motion that doesn't loop fades out towards its end, over at most half of it so it doesn't count as fading
+			// out from its first frame, that would restart an idle motion every frame
+			if (!track.player.isLooping()) {
+				track.endTime = motion->getDuration();
+				track.fadeOutTime = std::min(track.fadeOutTime, 0.5f * track.endTime);
+			}
+		}
+
+		void MotionStack::advance(Layer& layer, float deltatime) {
+			for (auto& track : layer.tracks) {
+				track.player.advance(deltatime);
+				track.elapsed += deltatime;
+			}
+
+			std::erase_if(layer.tracks, [](const Track& track) { return track.endTime >= 0.0f && track.elapsed >= track.endTime; });
+
+			// fade the idle motion back in once everything else, the current idle track included, is past the start of its
+			// fade out, an idle motion without a length has nothing to play
+			bool idlePlayable = layer.idleMotion && (layer.idleMotion->isLooping() || layer.idleMotion->getDuration() > 0.0f);
+			if (idlePlayable && std::all_of(layer.tracks.begin(), layer.tracks.end(), isFadingOut))
+				start(layer, layer.idleMotion, -1.0f, -1.0f);
+		}
+
+		void MotionStack::blend(const Layer& layer, Track& track) {
+			const Motion* motion = track.player.getMotion();
+			const MotionCurve* curves = motion->getCurves();
+
+			float fadeIn = fade(track.elapsed, track.fadeInTime);
+			float fadeOut = track.endTime < 0.0f ? 1.0f : fade(track.endTime - track.elapsed, track.fadeOutTime);
+			float weight = layer.weight * fadeIn * fadeOut;
+
+			for (size_t c = 0; c < motion->getCurveCount(); ++c) {
+				const MotionCurve& curve = curves[c];
+				if (curve.targetIndex == uint32_t(-1) || curve.target == MotionTarget::Model)
+					continue;
+
+				size_t slot = curve.target == MotionTarget::Parameter ? curve.targetIndex : m_parameterCount + curve.targetIndex;
+				if (slot >= m_values.size())
+					continue;
+
+				// curves with their own fade times fade on their own
+				float curveWeight = weight;
+				if (curve.fadeInTime >= 0.0f || curve.fadeOutTime >= 0.0f) {
+					float curveFadeIn = curve.fadeInTime < 0.0f ? fadeIn : fade(track.elapsed, curve.fadeInTime);
+					float curveFadeOut = curve.fadeOutTime < 0.0f || track.endTime < 0.0f ? fadeOut : fade(track.endTime - track.elapsed, curve.fadeOutTime);
+					curveWeight = layer.weight * curveFadeIn * curveFadeOut;
+				}
+
+				float value = track.player.evaluate(c);
+				if (layer.mode == MotionBlendMode::Override)
+					m_values[slot] += (value - m_values[slot]) * curveWeight;
+				else
+					m_values[slot] += (value - m_defaults[slot]) * curveWeight;
+				m_written[slot] = 1;
+			}
+		}
+
+		void MotionStack::load() {
+			const float* parameters = m_instance->getParameterValues();
+			const float* parts = m_instance->getPartOpacities();
+
+			// values the stack wrote last frame start from what they were before, the rest from what they are now
+			for (size_t i = 0; i < m_parameterCount; ++i) {
+				if (!m_written[i])
+					m_base[i] = parameters[i];
+			}
+			for (size_t i = m_parameterCount; i < m_values.size(); ++i) {
+				if (!m_written[i])
+					m_base[i] = parts[i - m_parameterCount];
+			}
+
+			std::copy(m_base.begin(), m_base.end(), m_values.begin());
+			std::fill(m_written.begin(), m_written.end(), 0);
+		}
+
+		void MotionStack::store() {
+			float* parameters = m_instance->getParameterValues();
+			float* parts = m_instance->getPartOpacities();
+			const float* minValues = m_instance->getParameterMinValues();
+			const float* maxValues = m_instance->getParameterMaxValues();
+
+			for (size_t i = 0; i < m_parameterCount; ++i)
+				parameters[i] = std::min(std::max(m_values[i], minValues[i]), maxValues[i]);
+			for (size_t i = m_parameterCount; i < m_values.size(); ++i)
+				parts[i - m_parameterCount] = std::clamp(m_values[i], 0.0f, 1.0f);
+		}
+
+	}
+}
@@ -0,0 +1,138 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "Motion.hpp"
+
+namespace luna {
+	namespace live2d {
+
+		class ModelInstance;
+
+		/**
+		 * @brief How the motions of a layer of a MotionStack combine with the layers below it
+		*/
+		enum class MotionBlendMode : uint8_t {
+			/**
+			 * @brief Blends from the value below towards the value of the motion by the weight of the layer
+			*/
+			Override,
+
+			/**
+			 * @brief Adds how far the motion is from the default value of the parameter, scaled by the weight of the layer.
+			 * Part opacities count 1 as their default.
+			*/
+			Additive,
+		};
+
+		/**
+		 * @brief Plays motions on a ModelInstance in layers. Every layer cross-fades from the motion it was playing to the
+		 * next one using the FadeInTime and FadeOutTime of the motions (or of the curves, when a curve has its own), and the
+		 * layers are blended from the bottom up. The blend happens in a scratch buffer that holds every parameter and part
+		 * opacity, which is clamped and written to the csmModel once at the end of update().
+		 *
+		 * A value the stack writes starts from what it was before the stack touched it, not from what the stack wrote last
+		 * frame, so additive layers don't accumulate and partial weights don't drift. While a motion drives a parameter the
+		 * stack owns it, setting it by hand only has an effect once no motion animates it anymore.
+		*/
+		class MotionStack {
+		public:
+			/**
+			 * @brief Creates a stack with a single override layer
+			*/
+			MotionStack();
+
+			/**
+			 * @brief Attaches this MotionStack to a ModelInstance, update() writes to the parameters and parts of this instance
+			 * @param instance The ModelInstance to animate, the motions have to be bound to its Model
+			*/
+			void attachTo(ModelInstance* instance);
+
+			/**
+			 * @brief Adds a layer on top of the stack
+			 * @return The index of the new layer
+			*/
+			size_t addLayer(MotionBlendMode mode = MotionBlendMode::Override, float weight = 1.0f);
+			size_t getLayerCount() const;
+
+			void setLayerWeight(size_t layer, float weight);
+			float getLayerWeight(size_t layer) const;
+
+			void setLayerMode(size_t layer, MotionBlendMode mode);
+			MotionBlendMode getLayerMode(size_t layer) const;
+
+			/**
+			 * @brief Starts a motion on a layer. The motions the layer was playing fade out while the new one fades in.
+			 * @param layer The index of the layer
+			 * @param motion The motion to play
+			 * @param fadeInTime How long the motion takes to fade in, negative to use the fade in time of the motion
+			 * @param fadeOutTime How long the motion takes to fade out, negative to use the fade out time of the motion
+			*/
+			void play(size_t layer, const Motion* motion, float fadeInTime = -1.0f, float fadeOutTime = -1.0f);
+
+			/**
+			 * @brief Sets a motion that the layer goes back to whenever it has nothing else to play, like an "Idle" motion
+			 * @param motion The motion, or nullptr to let the layer go quiet
+			*/
+			void setIdleMotion(size_t layer, const Motion* motion);
+
+			/**
+			 * @brief Fades out everything the layer is playing
+			*/
+			void stop(size_t layer);
+
+			/**
+			 * @return True if the layer is playing a motion that is not fading out
+			*/
+			bool isPlaying(size_t layer) const;
+
+			/**
+			 * @brief Advances all the motions, blends them, and writes the result to the attached ModelInstance
+			*/
+			void update(float deltatime);
+
+		private:
+			struct Track {
+				MotionPlayer player;
+				float elapsed = 0.0f;
+				float fadeInTime = 0.0f;
+				float fadeOutTime = 0.0f;
+
+				/**
+				 * @brief The elapsed time at which the track is done fading out, negative while it plays on
+				*/
+				float endTime = -1.0f;
+			};
+
+			struct Layer {
+				MotionBlendMode mode = MotionBlendMode::Override;
+				float weight = 1.0f;
+				const Motion* idleMotion = nullptr;
+				std::vector<Track> tracks;
+			};
+
+			static bool isFadingOut(const Track& track);
+			static void fadeOut(Track& track);
+			static void start(Layer& layer, const Motion* motion, float fadeInTime, float fadeOutTime);
+			static void advance(Layer& layer, float deltatime);
+			void blend(const Layer& layer, Track& track);
+			void load();
+			void store();
+
+		private:
+			ModelInstance* m_instance = nullptr;
+			std::vector<Layer> m_layers;
+
+			// the parameters followed by the part opacities
+			size_t m_parameterCount = 0;
+			std::vector<float> m_values;
+			std::vector<float> m_base;
+			std::vector<float> m_defaults;
+			std::vector<uint8_t> m_written;
+			bool m_blended = false;
+		};
+
+	}
+}
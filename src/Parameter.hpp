@@ -1,8 +1,21 @@
 #pragma once
 
+#include <cstddef>
+#include <cstdint>
+
 namespace luna {
 	namespace live2d {
 
+		/**
+		 * @brief A parameter id that has been resolved to an index once, see Model::getParameterHandle.
+		 * Looking up a Parameter through a handle is a single array access.
+		*/
+		struct ParameterHandle {
+			uint32_t index = uint32_t(-1);
+
+			bool isValid() const { return index != uint32_t(-1); }
+		};
+
 		/**
 		 * @brief A parameter to control the movement of the Live2D model, see the Cubism SDK documentation for reference
 		*/
@@ -1,9 +1,12 @@
 #include "Physics.hpp"
 
+#include <algorithm>
 #include <fstream>
 #include <nlohmann/json.hpp>
 
+#include "Model.hpp"
 #include "ModelInstance.hpp"
+#include "Simd.hpp"
 
 using json = nlohmann::json;
 
@@ -24,6 +27,35 @@ namespace luna {
 
 				return ret;
 			}
+
+			float outputValue(const PhysicsOutput& output, glm::vec2 translation, glm::vec2 parentGravity) {
+				float value = 0.0f;
+				switch (output.type) {
+
+				case PhysicsParameterType::Angle:
+					value = -directionToRadian(parentGravity, translation);
+					break;
+
+				case PhysicsParameterType::X:
+					value = translation.x;
+					break;
+
+				case PhysicsParameterType::Y:
+					value = translation.y;
+					break;
+
+				default:
+					break;
+
+				}
+
+				if (output.reflect)
+					value = -value;
+
+				value *= output.scale;
+				value *= output.weight / 100.0f;
+				return value;
+			}
 		}
 
 		PhysicsGroup::PhysicsGroup(std::string id, NormalizationParams positionNormalizationParams, NormalizationParams angleNormalizationParams, std::vector<PhysicsPendulumNode> nodes, std::vector<PhysicsInput> inputs, std::vector<PhysicsOutput> outputs) :
@@ -32,34 +64,51 @@ namespace luna {
 			m_angleNormalizationParams(angleNormalizationParams),
 			m_nodes(std::move(nodes)),
 			m_inputs(std::move(inputs)),
-			m_outputs(std::move(outputs)),
-			m_prevGravity(glm::vec2(0.0f, 1.0f))
+			m_outputs(std::move(outputs))
 		{}
 
-		void PhysicsGroup::attachTo(ModelInstance* instance) {
-			m_inputParams.clear();
-			m_outputParams.clear();
-
-			if (!instance) // only deattach when instance is nullptr
-				return;
-
+		void PhysicsGroup::bindTo(const Model& model) {
 			for (auto& input : m_inputs)
-				m_inputParams.push_back(instance->getParameter(input.paramId.c_str()));
+				input.parameter = model.getParameterHandle(input.paramId.c_str());
 
 			for (auto& output : m_outputs)
-				m_outputParams.push_back(instance->getParameter(output.paramId.c_str()));
+				output.parameter = model.getParameterHandle(output.paramId.c_str());
+		}
+
+		void PhysicsGroup::reset(PhysicsGroupState state) const {
+			for (size_t i = 0; i < m_nodes.size(); ++i) {
+				state.positions[i] = m_nodes[i].initialPosition;
+				state.velocities[i] = glm::vec2(0.0f);
+			}
+
+			*state.prevGravity = glm::vec2(0.0f, 1.0f);
+		}
+
+		void PhysicsGroup::update(PhysicsGroupState state, ModelInstance& instance, float deltatime) const {
+			step(state, instance, deltatime);
+			writeCurrentState(state, instance);
 		}
 
-		void PhysicsGroup::update(float deltatime) {
+		void PhysicsGroup::step(PhysicsGroupState state, const ModelInstance& instance, float deltatime) const {
+			float rotation = 0.0f;
+			glm::vec2 position;
+			readCurrentState(instance, rotation, position);
+			step(state, rotation, position, deltatime);
+		}
+
+		void PhysicsGroup::step(PhysicsGroupState state, float rotation, glm::vec2 position, float deltatime) const {
 			constexpr float maxWeight = 100.0f;
 			constexpr float airResistance = 5.0f;
 
-			float rotation = 0.0f;
-			readCurrentState(rotation, m_nodes[0].position);
+			glm::vec2* positions = state.positions;
+			glm::vec2* velocities = state.velocities;
+			const glm::vec2 prevGravity = *state.prevGravity;
+
+			positions[0] = position;
 
 			const glm::vec2 gravity = glm::vec2(sin(rotation * luna::DegToRad), cos(rotation * luna::DegToRad));
 			
-			const float deltaRotation = directionToRadian(m_prevGravity, gravity) / airResistance;
+			const float deltaRotation = directionToRadian(prevGravity, gravity) / airResistance;
 			const float cosDeltaRotation = cos(deltaRotation);
 			const float sinDeltaRotation = sin(deltaRotation);
 			glm::mat2 deltaRotationMatrix = glm::mat2(cosDeltaRotation, -sinDeltaRotation, sinDeltaRotation, cosDeltaRotation);
@@ -67,54 +116,110 @@ namespace luna {
 			for (size_t i = 1; i < m_nodes.size(); ++i) {
 				// get current forces and position
 				float dt = m_nodes[i].delay * deltatime * 30.0f; // deltatime put sped up
-				glm::vec2 prevPosition = m_nodes[i].position;
-				glm::vec2 prevAcceleration = m_prevGravity * m_nodes[i].acceleration;
+				glm::vec2 prevPosition = positions[i];
+				glm::vec2 prevAcceleration = prevGravity * m_nodes[i].acceleration;
 				glm::vec2 acceleration = gravity * m_nodes[i].acceleration;
 
 				// velocity verlet
-				glm::vec2 velocity = m_nodes[i].velocity + 0.25f * (acceleration + prevAcceleration) * dt;
-				m_nodes[i].position += velocity * dt;
+				glm::vec2 velocity = velocities[i] + 0.25f * (acceleration + prevAcceleration) * dt;
+				positions[i] += velocity * dt;
 
 				// make sure the node maintains its distance from the previous one
-				glm::vec2 newDirection = glm::normalize(m_nodes[i].position - m_nodes[i - 1].position);
-				m_nodes[i].position = m_nodes[i - 1].position + (newDirection * m_nodes[i].radius);
+				glm::vec2 newDirection = glm::normalize(positions[i] - positions[i - 1]);
+				positions[i] = positions[i - 1] + (newDirection * m_nodes[i].radius);
 
 				// make the pendulum stationary when the forces become too low
-				if (abs(m_nodes[i].position.x) < 0.001f * m_positionNormalizationParams.max)
-					m_nodes[i].position.x = 0.0f;
+				if (abs(positions[i].x) < 0.001f * m_positionNormalizationParams.max)
+					positions[i].x = 0.0f;
 
 				// update velocity
 				if (dt != 0.0f)
-					m_nodes[i].velocity = m_nodes[i].mobility * (m_nodes[i].position - prevPosition) / dt;
+					velocities[i] = m_nodes[i].mobility * (positions[i] - prevPosition) / dt;
+			}
+
+			*state.prevGravity = gravity;
+		}
+
+		void PhysicsGroup::stabilize(PhysicsGroupState state, ModelInstance& instance) const {
+			glm::vec2* positions = state.positions;
+
+			float rotation = 0.0f;
+			readCurrentState(instance, rotation, positions[0]);
+
+			const glm::vec2 gravity = glm::vec2(sin(rotation * luna::DegToRad), cos(rotation * luna::DegToRad));
+
+			for (size_t i = 1; i < m_nodes.size(); ++i) {
+				positions[i] = getRestPosition(i, positions[i - 1], gravity);
+				state.velocities[i] = glm::vec2(0.0f);
 			}
 
-			m_prevGravity = gravity;
-			writeCurrentState();
+			*state.prevGravity = gravity;
+			writeCurrentState(state, instance);
 		}
 
-		void PhysicsGroup::stabilize() {
-			// todo: implement
+		glm::vec2 PhysicsGroup::getRestPosition(size_t node, glm::vec2 parent, glm::vec2 gravity) const {
+			// at rest every node hangs straight from its parent in the direction the gravity pulls it, then the verlet step
+			// only moves it along that direction and the distance constraint puts it right back
+			glm::vec2 direction;
+			if (m_nodes[node].acceleration > 0.0f) {
+				direction = gravity;
+			} else if (m_nodes[node].acceleration < 0.0f) {
+				direction = -gravity;
+			} else {
+				// nothing pulls on this node, so it keeps its initial shape, a node that starts on its parent stays there
+				glm::vec2 offset = m_nodes[node].initialPosition - m_nodes[node - 1].initialPosition;
+				if (glm::dot(offset, offset) == 0.0f)
+					return parent;
+				direction = glm::normalize(offset);
+			}
+
+			glm::vec2 position = parent + direction * m_nodes[node].radius;
+
+			if (abs(position.x) < 0.001f * m_positionNormalizationParams.max)
+				position.x = 0.0f;
+
+			return position;
 		}
 
-		size_t PhysicsGroup::getNodeCount() {
-			return m_nodes.size();
+		const std::string& PhysicsGroup::getId() const {
+			return m_id;
 		}
 
-		PhysicsPendulumNode* PhysicsGroup::getNodes() {
-			return m_nodes.data();
+		const NormalizationParams& PhysicsGroup::getPositionNormalizationParams() const {
+			return m_positionNormalizationParams;
+		}
+
+		const NormalizationParams& PhysicsGroup::getAngleNormalizationParams() const {
+			return m_angleNormalizationParams;
+		}
+
+		const std::vector<PhysicsInput>& PhysicsGroup::getInputs() const {
+			return m_inputs;
+		}
+
+		const std::vector<PhysicsOutput>& PhysicsGroup::getOutputs() const {
+			return m_outputs;
+		}
+
+		size_t PhysicsGroup::getNodeCount() const {
+			return m_nodes.size();
 		}
 
 		const PhysicsPendulumNode* PhysicsGroup::getNodes() const {
 			return m_nodes.data();
 		}
 
-		void PhysicsGroup::readCurrentState(float& rotation, glm::vec2& position) {
+		size_t PhysicsGroup::getFirstNode() const {
+			return m_firstNode;
+		}
+
+		void PhysicsGroup::readCurrentState(const ModelInstance& instance, float& rotation, glm::vec2& position) const {
 			rotation = 0.0f;
 			position = glm::vec2(0.0f);
 
 			for (size_t i = 0; i < m_inputs.size(); ++i) {
 				auto& inputData = m_inputs[i];
-				auto* parameter = m_inputParams[i];
+				auto* parameter = instance.getParameter(inputData.parameter);
 
 				if (!parameter)
 					continue;
@@ -142,55 +247,23 @@ namespace luna {
 			}
 		}
 
-		void PhysicsGroup::writeCurrentState() {
+		void PhysicsGroup::writeCurrentState(PhysicsGroupState state, ModelInstance& instance) const {
 			for (size_t i = 0; i < m_outputs.size(); ++i) {
 				auto& outputData = m_outputs[i];
-				auto* parameter = m_outputParams[i];
+				auto* parameter = instance.getParameter(outputData.parameter);
 				int nodeIdx = outputData.pendulumNodeIndex;
 
-				if (!parameter || nodeIdx < 1 || nodeIdx > m_nodes.size())
+				if (!parameter || nodeIdx < 1 || size_t(nodeIdx) >= m_nodes.size())
 					continue;
 
-				glm::vec2 translation = m_nodes[nodeIdx].position - m_nodes[nodeIdx - 1].position;
-
-				float value = 0.0f;
-				switch (outputData.type) {
-
-				case PhysicsParameterType::Angle:
-					glm::vec2 parentGravity;
-					if (nodeIdx >= 2) {
-						parentGravity = m_nodes[nodeIdx - 1].position - m_nodes[nodeIdx - 2].position;
-					} else {
-						parentGravity = glm::vec2(0.0f, 1.0f);
-					}
-
-					value = -directionToRadian(parentGravity, translation);
-					break;
+				glm::vec2 translation = state.positions[nodeIdx] - state.positions[nodeIdx - 1];
+				glm::vec2 parentGravity = nodeIdx >= 2 ? state.positions[nodeIdx - 1] - state.positions[nodeIdx - 2] : glm::vec2(0.0f, 1.0f);
 
-				case PhysicsParameterType::X:
-					value = translation.x;
-					break;
-
-				case PhysicsParameterType::Y:
-					value = translation.y;
-					break;
-
-				default:
-					break;
-
-				}
-
-				if (outputData.reflect)
-					value = -value;
-
-				value *= outputData.scale;
-				value *= outputData.weight / 100.0f;
-				
-				parameter->setValue(value);
+				parameter->setValue(outputValue(outputData, translation, parentGravity));
 			}
 		}
 
-		PhysicsController::PhysicsController(const char* filepath) {
+		PhysicsRig::PhysicsRig(const char* filepath) {
 			// load file
 			std::ifstream file(filepath);
 			if (file.bad() || file.fail() || file.eof()) {
@@ -199,6 +272,10 @@ namespace luna {
 			}
 			json modelFile = json::parse(file);
 
+			// the rate the physics were authored at, not every exporter writes it
+			if (modelFile.contains("Meta") && modelFile.at("Meta").contains("Fps"))
+				m_fps = modelFile.at("Meta").at("Fps");
+
 			// parse the separate groups
 			auto& settings = modelFile.at("PhysicsSettings");
 			for (auto& group : settings) {
@@ -260,8 +337,6 @@ namespace luna {
 					node.delay = vertex.at("Delay");
 					node.acceleration = vertex.at("Acceleration");
 					node.radius = vertex.at("Radius");
-					node.position = node.initialPosition;
-					node.velocity = glm::vec2(0.0f);
 					nodes.push_back(node);
 				}
 
@@ -280,33 +355,738 @@ namespace luna {
 
 				m_groups.emplace_back(std::move(id), positionNormalizationParams, angleNormalizationParams, std::move(nodes), std::move(inputs), std::move(outputs));
 			}
+
+			buildLayout();
 		}
 
-		void PhysicsController::attachTo(ModelInstance* instance) {
+		PhysicsRig::PhysicsRig(std::vector<PhysicsGroup> groups, float fps) :
+			m_groups(std::move(groups)),
+			m_fps(fps)
+		{
+			buildLayout();
+		}
+
+		void PhysicsRig::bindTo(const Model& model) {
 			for (auto& group : m_groups)
-				group.attachTo(instance);
+				group.bindTo(model);
+		}
+
+		size_t PhysicsRig::getGroupCount() const {
+			return m_groups.size();
+		}
+
+		const PhysicsGroup* PhysicsRig::getGroups() const {
+			return m_groups.data();
+		}
+
+		size_t PhysicsRig::getNodeCount() const {
+			return m_nodeCount;
+		}
+
+		float PhysicsRig::getFps() const {
+			return m_fps;
+		}
+
+		const PhysicsRigLanes& PhysicsRig::getLanes() const {
+			return m_lanes;
+		}
+
+		void PhysicsRig::buildLayout() {
+			m_nodeCount = 0;
+			m_lanes = {};
+			for (auto& group : m_groups) {
+				group.m_firstNode = m_nodeCount;
+				m_nodeCount += group.getNodeCount();
+				m_lanes.levelCount = std::max(m_lanes.levelCount, group.getNodeCount());
+			}
+
+			// one lane per group, padded so the kernel never has to deal with a partial vector
+			m_lanes.laneCount = simd::padToWidth(m_groups.size());
+			size_t laneSize = m_lanes.levelCount * m_lanes.laneCount;
+			m_lanes.mobility.resize(laneSize, 0.0f);
+			m_lanes.delay.resize(laneSize, 0.0f);
+			m_lanes.acceleration.resize(laneSize, 0.0f);
+			m_lanes.radius.resize(laneSize, 0.0f);
+			m_lanes.active.resize(laneSize, 0.0f);
+			m_lanes.positionThreshold.resize(m_lanes.laneCount, 0.0f);
+
+			for (size_t g = 0; g < m_groups.size(); ++g) {
+				const auto& group = m_groups[g];
+				m_lanes.positionThreshold[g] = 0.001f * group.getPositionNormalizationParams().max;
+
+				for (size_t i = 0; i < group.getNodeCount(); ++i) {
+					size_t lane = i * m_lanes.laneCount + g;
+					m_lanes.mobility[lane] = group.getNodes()[i].mobility;
+					m_lanes.delay[lane] = group.getNodes()[i].delay;
+					m_lanes.acceleration[lane] = group.getNodes()[i].acceleration;
+					m_lanes.radius[lane] = group.getNodes()[i].radius;
+					m_lanes.active[lane] = 1.0f;
+				}
+			}
+		}
+
+		PhysicsController::PhysicsController(const PhysicsRig* rig) :
+			m_rig(rig)
+		{
+			size_t nodeCount = m_rig ? m_rig->getNodeCount() : 0;
+			size_t groupCount = m_rig ? m_rig->getGroupCount() : 0;
+
+			// all of the state lives in a single allocation: positions, velocities, the positions of the previous fixed
+			// step, the interpolated positions, and gravity per group
+			m_state = std::make_unique<glm::vec2[]>(nodeCount * 4 + groupCount);
+			m_positions = m_state.get();
+			m_velocities = m_positions + nodeCount;
+			m_prevPositions = m_velocities + nodeCount;
+			m_interpolatedPositions = m_prevPositions + nodeCount;
+			m_prevGravity = m_interpolatedPositions + nodeCount;
+
+			m_groupInputs.resize(groupCount);
+
+			reset();
+		}
+
+		void PhysicsController::attachTo(ModelInstance* instance) {
+			m_instance = instance;
+
+			// the state might have been changed from the outside while detached, e.g. by a PhysicsBatch
+			m_lanesOutdated = true;
+			wakeAll();
 		}
 
 		void PhysicsController::update(float deltatime) {
-			for (auto& group : m_groups)
-				group.update(deltatime);
+			if (!m_instance)
+				return;
+
+			m_awakeGroupCount = 0;
+
+			if (!m_fixedStep && m_kernel == PhysicsKernel::Scalar) {
+				// one group after another, so a group can read the outputs that the groups before it wrote this frame
+				for (size_t i = 0; i < m_rig->getGroupCount(); ++i) {
+					const PhysicsGroup& group = m_rig->getGroups()[i];
+
+					float rotation = 0.0f;
+					glm::vec2 position;
+					group.readCurrentState(*m_instance, rotation, position);
+					if (!wake(i, rotation, position))
+						continue;
+
+					group.step(getGroupState(i), rotation, position, deltatime);
+					group.writeCurrentState(getGroupState(i), *m_instance);
+					settle(i);
+				}
+
+				m_lanesOutdated = true;
+				return;
+			}
+
+			readInputs();
+			if (m_awakeGroupCount == 0)
+				return;
+
+			if (!m_fixedStep) {
+				step(deltatime);
+				writeOutputs(m_positions);
+				for (size_t i = 0; i < m_rig->getGroupCount(); ++i)
+					settle(i);
+				return;
+			}
+
+			// a long frame only advances the simulation this far, so a hitch doesn't turn into a burst of steps
+			constexpr float maxFrameTime = 0.25f;
+
+			const size_t nodeCount = m_rig->getNodeCount();
+			const float stepTime = getStepTime();
+
+			m_accumulator += std::min(deltatime, maxFrameTime);
+			while (m_accumulator >= stepTime) {
+				std::copy_n(m_positions, nodeCount, m_prevPositions);
+				step(stepTime);
+				m_accumulator -= stepTime;
+			}
+
+			// show the pendulums in between the last two steps
+			const float alpha = m_accumulator / stepTime;
+			for (size_t i = 0; i < nodeCount; ++i)
+				m_interpolatedPositions[i] = glm::mix(m_prevPositions[i], m_positions[i], alpha);
+
+			writeOutputs(m_interpolatedPositions);
+			for (size_t i = 0; i < m_rig->getGroupCount(); ++i)
+				settle(i);
 		}
 
 		void PhysicsController::stabilize() {
-			for (auto& group : m_groups)
-				group.stabilize();
+			if (!m_instance)
+				return;
+
+			for (size_t i = 0; i < m_rig->getGroupCount(); ++i)
+				m_rig->getGroups()[i].stabilize(getGroupState(i), *m_instance);
+			m_lanesOutdated = true;
+
+			// the fixed-step history starts at rest as well, so the interpolation doesn't blend in the old pose
+			std::copy_n(m_positions, m_rig->getNodeCount(), m_prevPositions);
+			m_accumulator = 0.0f;
+
+			// the pendulums are at rest now, so they can sleep until the inputs move
+			for (size_t i = 0; i < m_rig->getGroupCount(); ++i) {
+				GroupInputs& inputs = m_groupInputs[i];
+				m_rig->getGroups()[i].readCurrentState(*m_instance, inputs.rotation, inputs.position);
+				inputs.awake = !m_sleepEnabled;
+				inputs.moved = false;
+			}
 		}
 
-		size_t PhysicsController::getGroupCount() {
-			return m_groups.size();
+		void PhysicsController::reset() {
+			if (!m_rig)
+				return;
+
+			for (size_t i = 0; i < m_rig->getGroupCount(); ++i)
+				m_rig->getGroups()[i].reset(getGroupState(i));
+			m_lanesOutdated = true;
+
+			std::copy_n(m_positions, m_rig->getNodeCount(), m_prevPositions);
+			m_accumulator = 0.0f;
+			wakeAll();
 		}
 
-		PhysicsGroup* PhysicsController::getGroups() {
-			return m_groups.data();
+		void PhysicsController::setKernel(PhysicsKernel kernel) {
+			m_kernel = kernel;
+
+			if (m_kernel == PhysicsKernel::Simd && !m_laneState && m_rig) {
+				const auto& lanes = m_rig->getLanes();
+				size_t laneSize = lanes.levelCount * lanes.laneCount;
+
+				// 4 arrays for the nodes, 4 for the gravity of every group and whether it is awake
+				m_laneState = std::make_unique<float[]>(laneSize * 4 + lanes.laneCount * 5);
+				m_lanePositionX = m_laneState.get();
+				m_lanePositionY = m_lanePositionX + laneSize;
+				m_laneVelocityX = m_lanePositionY + laneSize;
+				m_laneVelocityY = m_laneVelocityX + laneSize;
+				m_laneGravityX = m_laneVelocityY + laneSize;
+				m_laneGravityY = m_laneGravityX + lanes.laneCount;
+				m_lanePrevGravityX = m_laneGravityY + lanes.laneCount;
+				m_lanePrevGravityY = m_lanePrevGravityX + lanes.laneCount;
+				m_laneAwake = m_lanePrevGravityY + lanes.laneCount;
+				m_lanesOutdated = true;
+			}
 		}
 
-		const PhysicsGroup* PhysicsController::getGroups() const {
-			return m_groups.data();
+		PhysicsKernel PhysicsController::getKernel() const {
+			return m_kernel;
+		}
+
+		void PhysicsController::setFixedStep(bool enabled) {
+			if (m_fixedStep == enabled)
+				return;
+
+			m_fixedStep = enabled;
+			if (m_rig)
+				std::copy_n(m_positions, m_rig->getNodeCount(), m_prevPositions);
+			m_accumulator = 0.0f;
+		}
+
+		bool PhysicsController::isFixedStep() const {
+			return m_fixedStep;
+		}
+
+		void PhysicsController::setSleepEnabled(bool enabled) {
+			m_sleepEnabled = enabled;
+			wakeAll();
+		}
+
+		bool PhysicsController::isSleepEnabled() const {
+			return m_sleepEnabled;
+		}
+
+		size_t PhysicsController::getAwakeGroupCount() const {
+			return m_awakeGroupCount;
+		}
+
+		float PhysicsController::getStepTime() const {
+			// the simulation is tuned for 30 steps per second when the file doesn't say otherwise
+			float fps = m_rig && m_rig->getFps() > 0.0f ? m_rig->getFps() : 30.0f;
+			return 1.0f / fps;
+		}
+
+		const PhysicsRig* PhysicsController::getRig() const {
+			return m_rig;
+		}
+
+		PhysicsGroupState PhysicsController::getGroupState(size_t group) {
+			size_t firstNode = m_rig->getGroups()[group].getFirstNode();
+			return PhysicsGroupState{ m_positions + firstNode, m_velocities + firstNode, m_prevGravity + group };
+		}
+
+		const glm::vec2* PhysicsController::getNodePositions() const {
+			return m_positions;
+		}
+
+		const glm::vec2* PhysicsController::getNodeVelocities() const {
+			return m_velocities;
+		}
+
+		bool PhysicsController::wake(size_t group, float rotation, glm::vec2 position) {
+			GroupInputs& inputs = m_groupInputs[group];
+
+			if (m_sleepEnabled) {
+				const PhysicsGroup& physicsGroup = m_rig->getGroups()[group];
+				const float angleEpsilon = 0.001f * physicsGroup.getAngleNormalizationParams().max;
+				const float positionEpsilon = 0.001f * physicsGroup.getPositionNormalizationParams().max;
+
+				// compared to the inputs of the last step, or to the inputs it fell asleep with
+				bool moved = abs(rotation - inputs.rotation) > angleEpsilon ||
+					abs(position.x - inputs.position.x) > positionEpsilon ||
+					abs(position.y - inputs.position.y) > positionEpsilon;
+
+				if (!inputs.awake && !moved)
+					return false;
+
+				inputs.moved = moved;
+			}
+
+			inputs.awake = true;
+			inputs.rotation = rotation;
+			inputs.position = position;
+			++m_awakeGroupCount;
+			return true;
+		}
+
+		void PhysicsController::settle(size_t group) {
+			GroupInputs& inputs = m_groupInputs[group];
+			if (!m_sleepEnabled || !inputs.awake || inputs.moved)
+				return;
+
+			const PhysicsGroup& physicsGroup = m_rig->getGroups()[group];
+			const float threshold = 0.001f * physicsGroup.getPositionNormalizationParams().max;
+			const size_t firstNode = physicsGroup.getFirstNode();
+			const glm::vec2 gravity = glm::vec2(sin(inputs.rotation * luna::DegToRad), cos(inputs.rotation * luna::DegToRad));
+
+			// slow nodes alone are not enough, a heavily damped pendulum keeps creeping towards its rest pose
+			glm::vec2 rest = inputs.position;
+			for (size_t i = 1; i < physicsGroup.getNodeCount(); ++i) {
+				const glm::vec2 velocity = m_velocities[firstNode + i];
+				if (abs(velocity.x) >= threshold || abs(velocity.y) >= threshold)
+					return;
+
+				rest = physicsGroup.getRestPosition(i, rest, gravity);
+				const glm::vec2 offset = m_positions[firstNode + i] - rest;
+				if (abs(offset.x) >= threshold || abs(offset.y) >= threshold)
+					return;
+			}
+
+			inputs.awake = false;
+			std::copy_n(m_positions + firstNode, physicsGroup.getNodeCount(), m_prevPositions + firstNode);
+		}
+
+		void PhysicsController::wakeAll() {
+			for (auto& inputs : m_groupInputs) {
+				inputs.awake = true;
+				inputs.moved = true;
+			}
+		}
+
+		void PhysicsController::readInputs() {
+			if (m_kernel == PhysicsKernel::Simd && m_lanesOutdated)
+				gatherLanes();
+
+			for (size_t g = 0; g < m_rig->getGroupCount(); ++g) {
+				float rotation = 0.0f;
+				glm::vec2 position;
+				m_rig->getGroups()[g].readCurrentState(*m_instance, rotation, position);
+				bool awake = wake(g, rotation, position);
+
+				if (m_kernel != PhysicsKernel::Simd)
+					continue;
+
+				m_laneAwake[g] = awake ? 1.0f : 0.0f;
+				if (awake) {
+					m_lanePositionX[g] = position.x;
+					m_lanePositionY[g] = position.y;
+					m_laneGravityX[g] = sin(rotation * luna::DegToRad);
+					m_laneGravityY[g] = cos(rotation * luna::DegToRad);
+				}
+			}
+		}
+
+		void PhysicsController::step(float deltatime) {
+			if (m_kernel == PhysicsKernel::Simd) {
+				stepSimd(deltatime);
+				return;
+			}
+
+			for (size_t i = 0; i < m_rig->getGroupCount(); ++i) {
+				const GroupInputs& inputs = m_groupInputs[i];
+				if (inputs.awake)
+					m_rig->getGroups()[i].step(getGroupState(i), inputs.rotation, inputs.position, deltatime);
+			}
+			m_lanesOutdated = true;
+		}
+
+		void PhysicsController::writeOutputs(glm::vec2* positions) {
+			for (size_t i = 0; i < m_rig->getGroupCount(); ++i) {
+				if (!m_groupInputs[i].awake)
+					continue;
+
+				size_t firstNode = m_rig->getGroups()[i].getFirstNode();
+				m_rig->getGroups()[i].writeCurrentState(PhysicsGroupState{ positions + firstNode, m_velocities + firstNode, m_prevGravity + i }, *m_instance);
+			}
+		}
+
+		void PhysicsController::stepSimd(float deltatime) {
+			using namespace simd;
+
+			const auto& lanes = m_rig->getLanes();
+			const size_t laneCount = lanes.laneCount;
+
+			// the inputs were put in the lanes by readInputs(), that part is different for every group so it stays scalar
+			// simulate every chain in lockstep, this is the same math as PhysicsGroup::update
+			const Float zero = set(0.0f);
+			const Float one = set(1.0f);
+			const Float quarter = set(0.25f);
+			const Float deltatimes = set(deltatime);
+			const Float timeScale = set(30.0f);
+
+			for (size_t lane = 0; lane < laneCount; lane += Width) {
+				const Float gravityX = load(m_laneGravityX + lane);
+				const Float gravityY = load(m_laneGravityY + lane);
+				const Float prevGravityX = load(m_lanePrevGravityX + lane);
+				const Float prevGravityY = load(m_lanePrevGravityY + lane);
+				const Float threshold = load(lanes.positionThreshold.data() + lane);
+				const Mask awake = load(m_laneAwake + lane) != zero;
+
+				for (size_t level = 1; level < lanes.levelCount; ++level) {
+					const size_t i = level * laneCount + lane;
+					const size_t parent = i - laneCount;
+
+					const Mask active = (load(lanes.active.data() + i) != zero) & awake;
+					const Float dt = load(lanes.delay.data() + i) * deltatimes * timeScale; // same rounding as the scalar kernel
+					const Float acceleration = load(lanes.acceleration.data() + i);
+
+					const Float prevPositionX = load(m_lanePositionX + i);
+					const Float prevPositionY = load(m_lanePositionY + i);
+					const Float parentX = load(m_lanePositionX + parent);
+					const Float parentY = load(m_lanePositionY + parent);
+
+					// velocity verlet
+					Float velocityX = load(m_laneVelocityX + i) + quarter * (gravityX * acceleration + prevGravityX * acceleration) * dt;
+					Float velocityY = load(m_laneVelocityY + i) + quarter * (gravityY * acceleration + prevGravityY * acceleration) * dt;
+					Float positionX = prevPositionX + velocityX * dt;
+					Float positionY = prevPositionY + velocityY * dt;
+
+					// make sure the node maintains its distance from the previous one
+					const Float directionX = positionX - parentX;
+					const Float directionY = positionY - parentY;
+					const Float lengthSquared = directionX * directionX + directionY * directionY;
+					const Float inverseLength = one / sqrt(select(active, lengthSquared, one));
+					const Float radius = load(lanes.radius.data() + i);
+					positionX = parentX + directionX * inverseLength * radius;
+					positionY = parentY + directionY * inverseLength * radius;
+
+					// make the pendulum stationary when the forces become too low
+					positionX = select(abs(positionX) < threshold, zero, positionX);
+
+					// update velocity
+					const Mask moving = dt != zero;
+					const Float safeDt = select(moving, dt, one);
+					const Float mobility = load(lanes.mobility.data() + i);
+					velocityX = select(moving, mobility * (positionX - prevPositionX) / safeDt, load(m_laneVelocityX + i));
+					velocityY = select(moving, mobility * (positionY - prevPositionY) / safeDt, load(m_laneVelocityY + i));
+
+					// padding lanes and sleeping groups keep their state, the safe divisions above keep them from producing NaNs or infinities
+					store(m_lanePositionX + i, select(active, positionX, prevPositionX));
+					store(m_lanePositionY + i, select(active, positionY, prevPositionY));
+					store(m_laneVelocityX + i, select(active, velocityX, load(m_laneVelocityX + i)));
+					store(m_laneVelocityY + i, select(active, velocityY, load(m_laneVelocityY + i)));
+				}
+
+				store(m_lanePrevGravityX + lane, select(awake, gravityX, prevGravityX));
+				store(m_lanePrevGravityY + lane, select(awake, gravityY, prevGravityY));
+			}
+
+			// the outputs are written from the regular layout
+			scatterLanes();
+		}
+
+		void PhysicsController::gatherLanes() {
+			const auto& lanes = m_rig->getLanes();
+			for (size_t g = 0; g < m_rig->getGroupCount(); ++g) {
+				const auto& group = m_rig->getGroups()[g];
+				for (size_t i = 0; i < lanes.levelCount; ++i) {
+					size_t lane = i * lanes.laneCount + g;
+					glm::vec2 position = i < group.getNodeCount() ? m_positions[group.getFirstNode() + i] : glm::vec2(0.0f);
+					glm::vec2 velocity = i < group.getNodeCount() ? m_velocities[group.getFirstNode() + i] : glm::vec2(0.0f);
+					m_lanePositionX[lane] = position.x;
+					m_lanePositionY[lane] = position.y;
+					m_laneVelocityX[lane] = velocity.x;
+					m_laneVelocityY[lane] = velocity.y;
+				}
+
+				m_lanePrevGravityX[g] = m_prevGravity[g].x;
+				m_lanePrevGravityY[g] = m_prevGravity[g].y;
+			}
+
+			m_lanesOutdated = false;
+		}
+
+		void PhysicsController::scatterLanes() {
+			const auto& lanes = m_rig->getLanes();
+			for (size_t g = 0; g < m_rig->getGroupCount(); ++g) {
+				const auto& group = m_rig->getGroups()[g];
+				for (size_t i = 0; i < group.getNodeCount(); ++i) {
+					size_t lane = i * lanes.laneCount + g;
+					m_positions[group.getFirstNode() + i] = glm::vec2(m_lanePositionX[lane], m_lanePositionY[lane]);
+					m_velocities[group.getFirstNode() + i] = glm::vec2(m_laneVelocityX[lane], m_laneVelocityY[lane]);
+				}
+
+				m_prevGravity[g] = glm::vec2(m_lanePrevGravityX[g], m_lanePrevGravityY[g]);
+			}
+		}
+
+		PhysicsBatch::PhysicsBatch(const Model* model) :
+			m_model(model),
+			m_rig(model ? model->getPhysicsRig() : nullptr)
+		{}
+
+		PhysicsBatch::~PhysicsBatch() {
+			storeState();
+			for (auto* instance : m_instances)
+				instance->getPhysicsController()->attachTo(instance);
+		}
+
+		bool PhysicsBatch::add(ModelInstance* instance) {
+			if (!m_rig || !instance || instance->getModel() != m_model || !instance->getPhysicsController())
+				return false;
+
+			if (std::find(m_instances.begin(), m_instances.end(), instance) != m_instances.end())
+				return true;
+
+			// hand the state back to the controllers, so it survives changing the amount of lanes
+			storeState();
+			m_instances.push_back(instance);
+			instance->getPhysicsController()->attachTo(nullptr);
+			loadState();
+			return true;
+		}
+
+		void PhysicsBatch::remove(ModelInstance* instance) {
+			auto it = std::find(m_instances.begin(), m_instances.end(), instance);
+			if (it == m_instances.end())
+				return;
+
+			storeState();
+			m_instances.erase(it);
+			instance->getPhysicsController()->attachTo(instance);
+			loadState();
+		}
+
+		void PhysicsBatch::update(float deltatime) {
+			using namespace simd;
+
+			if (m_instances.empty())
+				return;
+
+			const size_t laneCount = m_laneCount;
+			const PhysicsGroup* groups = m_rig->getGroups();
+
+			// read the inputs of every instance
+			for (size_t k = 0; k < m_instances.size(); ++k) {
+				for (size_t g = 0; g < m_rig->getGroupCount(); ++g) {
+					float rotation = 0.0f;
+					glm::vec2 root;
+					groups[g].readCurrentState(*m_instances[k], rotation, root);
+
+					size_t lane = groups[g].getFirstNode() * laneCount + k;
+					m_positionX[lane] = root.x;
+					m_positionY[lane] = root.y;
+					m_gravityX[g * laneCount + k] = sin(rotation * luna::DegToRad);
+					m_gravityY[g * laneCount + k] = cos(rotation * luna::DegToRad);
+				}
+			}
+
+			// simulate all instances in lockstep, this is the same math as PhysicsGroup::update
+			const Float zero = set(0.0f);
+			const Float one = set(1.0f);
+			const Float quarter = set(0.25f);
+
+			for (size_t g = 0; g < m_rig->getGroupCount(); ++g) {
+				const PhysicsGroup& group = groups[g];
+				const PhysicsPendulumNode* nodes = group.getNodes();
+				const Float threshold = set(0.001f * group.getPositionNormalizationParams().max);
+
+				for (size_t lane = 0; lane < laneCount; lane += Width) {
+					const size_t gravityIdx = g * laneCount + lane;
+					const Float gravityX = load(m_gravityX + gravityIdx);
+					const Float gravityY = load(m_gravityY + gravityIdx);
+					const Float prevGravityX = load(m_prevGravityX + gravityIdx);
+					const Float prevGravityY = load(m_prevGravityY + gravityIdx);
+
+					for (size_t i = 1; i < group.getNodeCount(); ++i) {
+						const size_t idx = (group.getFirstNode() + i) * laneCount + lane;
+						const size_t parent = idx - laneCount;
+
+						// the constants are the same for every instance
+						const float dtScalar = nodes[i].delay * deltatime * 30.0f;
+						const Float dt = set(dtScalar);
+						const Float acceleration = set(nodes[i].acceleration);
+
+						const Float prevPositionX = load(m_positionX + idx);
+						const Float prevPositionY = load(m_positionY + idx);
+						const Float parentX = load(m_positionX + parent);
+						const Float parentY = load(m_positionY + parent);
+
+						// velocity verlet
+						const Float velocityX = load(m_velocityX + idx) + quarter * (gravityX * acceleration + prevGravityX * acceleration) * dt;
+						const Float velocityY = load(m_velocityY + idx) + quarter * (gravityY * acceleration + prevGravityY * acceleration) * dt;
+						Float positionX = prevPositionX + velocityX * dt;
+						Float positionY = prevPositionY + velocityY * dt;
+
+						// make sure the node maintains its distance from the previous one
+						const Float directionX = positionX - parentX;
+						const Float directionY = positionY - parentY;
+						const Float inverseLength = one / sqrt(directionX * directionX + directionY * directionY);
+						const Float radius = set(nodes[i].radius);
+						positionX = parentX + directionX * inverseLength * radius;
+						positionY = parentY + directionY * inverseLength * radius;
+
+						// make the pendulum stationary when the forces become too low
+						positionX = select(abs(positionX) < threshold, zero, positionX);
+
+						store(m_positionX + idx, positionX);
+						store(m_positionY + idx, positionY);
+
+						// update velocity
+						if (dtScalar != 0.0f) {
+							const Float mobility = set(nodes[i].mobility);
+							store(m_velocityX + idx, mobility * (positionX - prevPositionX) / dt);
+							store(m_velocityY + idx, mobility * (positionY - prevPositionY) / dt);
+						}
+					}
+
+					store(m_prevGravityX + gravityIdx, gravityX);
+					store(m_prevGravityY + gravityIdx, gravityY);
+				}
+			}
+
+			// write the outputs straight from the lanes
+			for (size_t k = 0; k < m_instances.size(); ++k) {
+				for (size_t g = 0; g < m_rig->getGroupCount(); ++g) {
+					const PhysicsGroup& group = groups[g];
+					auto position = [&](int node) {
+						size_t lane = (group.getFirstNode() + node) * laneCount + k;
+						return glm::vec2(m_positionX[lane], m_positionY[lane]);
+					};
+
+					for (auto& outputData : group.getOutputs()) {
+						auto* parameter = m_instances[k]->getParameter(outputData.parameter);
+						int nodeIdx = outputData.pendulumNodeIndex;
+
+						if (!parameter || nodeIdx < 1 || size_t(nodeIdx) >= group.getNodeCount())
+							continue;
+
+						glm::vec2 translation = position(nodeIdx) - position(nodeIdx - 1);
+						glm::vec2 parentGravity = nodeIdx >= 2 ? position(nodeIdx - 1) - position(nodeIdx - 2) : glm::vec2(0.0f, 1.0f);
+
+						parameter->setValue(outputValue(outputData, translation, parentGravity));
+					}
+				}
+			}
+		}
+
+		void PhysicsBatch::stabilize() {
+			// the rest pose is solved per instance, so this borrows the controllers for a moment
+			storeState();
+			for (auto* instance : m_instances) {
+				PhysicsController* controller = instance->getPhysicsController();
+				controller->attachTo(instance);
+				controller->stabilize();
+				controller->attachTo(nullptr);
+			}
+			loadState();
+		}
+
+		void PhysicsBatch::reset() {
+			if (!m_rig)
+				return;
+
+			for (size_t g = 0; g < m_rig->getGroupCount(); ++g) {
+				const PhysicsGroup& group = m_rig->getGroups()[g];
+				for (size_t i = 0; i < group.getNodeCount(); ++i) {
+					size_t first = (group.getFirstNode() + i) * m_laneCount;
+					std::fill_n(m_positionX + first, m_laneCount, group.getNodes()[i].initialPosition.x);
+					std::fill_n(m_positionY + first, m_laneCount, group.getNodes()[i].initialPosition.y);
+					std::fill_n(m_velocityX + first, m_laneCount, 0.0f);
+					std::fill_n(m_velocityY + first, m_laneCount, 0.0f);
+				}
+
+				std::fill_n(m_gravityX + g * m_laneCount, m_laneCount, 0.0f);
+				std::fill_n(m_gravityY + g * m_laneCount, m_laneCount, 1.0f);
+				std::fill_n(m_prevGravityX + g * m_laneCount, m_laneCount, 0.0f);
+				std::fill_n(m_prevGravityY + g * m_laneCount, m_laneCount, 1.0f);
+			}
+		}
+
+		size_t PhysicsBatch::getInstanceCount() const {
+			return m_instances.size();
+		}
+
+		ModelInstance* const* PhysicsBatch::getInstances() const {
+			return m_instances.data();
+		}
+
+		void PhysicsBatch::storeState() {
+			for (size_t k = 0; k < m_instances.size(); ++k) {
+				PhysicsController* controller = m_instances[k]->getPhysicsController();
+				for (size_t g = 0; g < m_rig->getGroupCount(); ++g) {
+					const PhysicsGroup& group = m_rig->getGroups()[g];
+					PhysicsGroupState state = controller->getGroupState(g);
+
+					for (size_t i = 0; i < group.getNodeCount(); ++i) {
+						size_t lane = (group.getFirstNode() + i) * m_laneCount + k;
+						state.positions[i] = glm::vec2(m_positionX[lane], m_positionY[lane]);
+						state.velocities[i] = glm::vec2(m_velocityX[lane], m_velocityY[lane]);
+					}
+
+					*state.prevGravity = glm::vec2(m_prevGravityX[g * m_laneCount + k], m_prevGravityY[g * m_laneCount + k]);
+				}
+			}
+		}
+
+		void PhysicsBatch::loadState() {
+			const size_t nodeCount = m_rig->getNodeCount();
+			const size_t groupCount = m_rig->getGroupCount();
+
+			// 4 arrays for the nodes and 4 for the gravity of every group, each with a lane per instance
+			m_laneCount = simd::padToWidth(m_instances.size());
+			m_state.assign(m_laneCount * (nodeCount * 4 + groupCount * 4), 0.0f);
+			m_positionX = m_state.data();
+			m_positionY = m_positionX + nodeCount * m_laneCount;
+			m_velocityX = m_positionY + nodeCount * m_laneCount;
+			m_velocityY = m_velocityX + nodeCount * m_laneCount;
+			m_gravityX = m_velocityY + nodeCount * m_laneCount;
+			m_gravityY = m_gravityX + groupCount * m_laneCount;
+			m_prevGravityX = m_gravityY + groupCount * m_laneCount;
+			m_prevGravityY = m_prevGravityX + groupCount * m_laneCount;
+
+			// the padding lanes keep the initial state
+			reset();
+
+			for (size_t k = 0; k < m_instances.size(); ++k) {
+				PhysicsController* controller = m_instances[k]->getPhysicsController();
+				const glm::vec2* positions = controller->getNodePositions();
+				const glm::vec2* velocities = controller->getNodeVelocities();
+
+				for (size_t n = 0; n < nodeCount; ++n) {
+					m_positionX[n * m_laneCount + k] = positions[n].x;
+					m_positionY[n * m_laneCount + k] = positions[n].y;
+					m_velocityX[n * m_laneCount + k] = velocities[n].x;
+					m_velocityY[n * m_laneCount + k] = velocities[n].y;
+				}
+
+				for (size_t g = 0; g < groupCount; ++g) {
+					glm::vec2 prevGravity = *controller->getGroupState(g).prevGravity;
+					m_prevGravityX[g * m_laneCount + k] = prevGravity.x;
+					m_prevGravityY[g * m_laneCount + k] = prevGravity.y;
+				}
+			}
 		}
 
 	}
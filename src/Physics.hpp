@@ -3,6 +3,7 @@
 #include <vector>
 #include <string>
 #include <functional>
+#include <memory>
 #include <luna.hpp>
 
 #include "Parameter.hpp"
@@ -10,6 +11,7 @@
 namespace luna {
 	namespace live2d {
 
+		class Model;
 		class ModelInstance;
 
 		enum class PhysicsParameterType : uint8_t {
@@ -27,6 +29,7 @@ namespace luna {
 			PhysicsParameterType type;
 			float weight;
 			bool reflect;
+			ParameterHandle parameter;
 		};
 
 		struct PhysicsOutput {
@@ -36,6 +39,7 @@ namespace luna {
 			float weight;
 			float scale;
 			bool reflect;
+			ParameterHandle parameter;
 		};
 
 		struct PhysicsPendulumNode {
@@ -44,64 +48,204 @@ namespace luna {
 			float delay;
 			float acceleration;
 			float radius;
+		};
+
+		/**
+		 * @brief The node constants of all the groups of a PhysicsRig in structure-of-arrays form, used by the SIMD kernel.
+		 * Node i of group g lives at index i * laneCount + g. Groups with shorter chains are padded up to the longest chain,
+		 * the padding is marked as inactive.
+		*/
+		struct PhysicsRigLanes {
+			size_t levelCount = 0;
+			size_t laneCount = 0;
+
+			std::vector<float> mobility;
+			std::vector<float> delay;
+			std::vector<float> acceleration;
+			std::vector<float> radius;
+			std::vector<float> active;
+
+			/**
+			 * @brief Per group, the threshold below which the x position of a node snaps to 0
+			*/
+			std::vector<float> positionThreshold;
+		};
+
+		/**
+		 * @brief Which implementation a PhysicsController uses to run the pendulum simulation
+		*/
+		enum class PhysicsKernel : uint8_t {
+			/**
+			 * @brief Simulates the groups one after another with scalar math
+			*/
+			Scalar,
+
+			/**
+			 * @brief Simulates the chains of all groups in lockstep with SIMD instructions (AVX, SSE2 or NEON), with the
+			 * nodes stored in structure-of-arrays form. It does the same operations in the same order as the Scalar kernel,
+			 * so the results are identical unless the compiler fuses the scalar math into multiply-adds. The outputs were
+			 * measured within 1e-4 of the Scalar kernel (in parameter units) on the bundled models, see physics_benchmark.
+			*/
+			Simd,
+		};
 
-			glm::vec2 position;
-			glm::vec2 velocity;
+		/**
+		 * @brief The simulation state of a single PhysicsGroup, it points into the state of a PhysicsController
+		*/
+		struct PhysicsGroupState {
+			glm::vec2* positions;
+			glm::vec2* velocities;
+			glm::vec2* prevGravity;
 		};
 
 		/**
 		 * @brief Called a Group in the physics settings within the Live2D application. This represents a single pendulum simulation with multiple Parameters as input/output.
+		 * A PhysicsGroup only holds the settings of the simulation, which are shared by all the instances of a Model. The state of the
+		 * simulation lives in a PhysicsGroupState.
 		*/
 		class PhysicsGroup {
 		public:
 			PhysicsGroup(std::string id, NormalizationParams positionNormalizationParams, NormalizationParams angleNormalizationParams, std::vector<PhysicsPendulumNode> nodes, std::vector<PhysicsInput> inputs, std::vector<PhysicsOutput> outputs);
 
 			/**
-			 * @brief Attaches this PhysicsGroup to a ModelInstance, so when you call update() on this
-			 * controller, it will update the ModelInstance's parameters.
-			 * @param instance The ModelInstance you want this PhysicsGroup to be attached to
+			 * @brief Resolves the ids of the input and output parameters to handles of the given Model
+			 * @param model The Model this group will be used with
 			*/
-			void attachTo(ModelInstance* instance);
+			void bindTo(const Model& model);
+
+			/**
+			 * @brief Puts the pendulum in its initial position
+			*/
+			void reset(PhysicsGroupState state) const;
 
 			/**
 			 * @brief Updates the pendulum simulation and writes to the values of all the connected parameters
 			*/
-			void update(float deltatime);
+			void update(PhysicsGroupState state, ModelInstance& instance, float deltatime) const;
+
+			/**
+			 * @brief Reads the input parameters and advances the pendulum simulation, without writing to the output parameters
+			*/
+			void step(PhysicsGroupState state, const ModelInstance& instance, float deltatime) const;
+
+			/**
+			 * @brief Advances the pendulum simulation with input values that were already read through readCurrentState()
+			*/
+			void step(PhysicsGroupState state, float rotation, glm::vec2 position, float deltatime) const;
 
 			/**
 			 * @brief Sets the simulated pendulum in a state where all forces on it cancel out, so there
 			 * will be no movement  until one of the input parameters changes. It might make sense to call
 			 * this after changing the Parameters in a non-continuous way to avoid a sudden jerk in the
-			 * physics.
+			 * physics. The rest pose is computed directly from the input parameters, with every node hanging
+			 * from its parent in the direction of the gravity, and written to the output parameters.
 			*/
-			void stabilize();
+			void stabilize(PhysicsGroupState state, ModelInstance& instance) const;
+
+			/**
+			 * @param node The index of the node, has to be at least 1
+			 * @param parent The rest position of the node before it
+			 * @param gravity The direction of the gravity
+			 * @return The position where the node comes to rest
+			*/
+			glm::vec2 getRestPosition(size_t node, glm::vec2 parent, glm::vec2 gravity) const;
 
-			size_t getNodeCount();
-			PhysicsPendulumNode* getNodes();
+			/**
+			 * @brief Reads the input parameters of this group
+			 * @param instance The ModelInstance to read the parameters from
+			 * @param rotation The rotation of the gravity, in degrees
+			 * @param position The position of the root of the pendulum
+			*/
+			void readCurrentState(const ModelInstance& instance, float& rotation, glm::vec2& position) const;
+
+			/**
+			 * @brief Writes the state of the pendulum to the output parameters of this group
+			*/
+			void writeCurrentState(PhysicsGroupState state, ModelInstance& instance) const;
+
+			const std::string& getId() const;
+			const NormalizationParams& getPositionNormalizationParams() const;
+			const NormalizationParams& getAngleNormalizationParams() const;
+			const std::vector<PhysicsInput>& getInputs() const;
+			const std::vector<PhysicsOutput>& getOutputs() const;
+
+			size_t getNodeCount() const;
 			const PhysicsPendulumNode* getNodes() const;
 
-		private:
-			void readCurrentState(float& rotation, glm::vec2& position);
-			void writeCurrentState();
+			/**
+			 * @return The index of the first node of this group within all the nodes of the PhysicsRig
+			*/
+			size_t getFirstNode() const;
 
 		private:
+			friend class PhysicsRig;
+
 			std::string m_id;
+			NormalizationParams m_positionNormalizationParams;
+			NormalizationParams m_angleNormalizationParams;
 			std::vector<PhysicsPendulumNode> m_nodes;
 			std::vector<PhysicsInput> m_inputs;
 			std::vector<PhysicsOutput> m_outputs;
-			std::vector<Parameter*> m_inputParams;
-			std::vector<Parameter*> m_outputParams;
-			NormalizationParams m_positionNormalizationParams;
-			NormalizationParams m_angleNormalizationParams;
-			glm::vec2 m_prevGravity;
+			size_t m_firstNode = 0;
+		};
+
+		/**
+		 * @brief The physics settings of a Model, loaded from a .physics3.json file. A Model owns a single
+		 * PhysicsRig which is shared by the PhysicsControllers of all its instances.
+		*/
+		class PhysicsRig {
+		public:
+			/**
+			 * @param filepath The path to the .physics3.json file
+			*/
+			explicit PhysicsRig(const char* filepath);
+			explicit PhysicsRig(std::vector<PhysicsGroup> groups, float fps = 0.0f);
+
+			/**
+			 * @brief Resolves the ids of all the input and output parameters to handles of the given Model
+			 * @param model The Model this rig will be used with
+			*/
+			void bindTo(const Model& model);
+
+			size_t getGroupCount() const;
+			const PhysicsGroup* getGroups() const;
+
+			/**
+			 * @return The amount of nodes of all the groups combined
+			*/
+			size_t getNodeCount() const;
+
+			/**
+			 * @return The rate the physics were authored at (Meta.Fps in the .physics3.json file), or 0 if the file does not specify it
+			*/
+			float getFps() const;
+
+			/**
+			 * @return The node constants of all groups in structure-of-arrays form
+			*/
+			const PhysicsRigLanes& getLanes() const;
+
+		private:
+			void buildLayout();
+
+		private:
+			std::vector<PhysicsGroup> m_groups;
+			size_t m_nodeCount = 0;
+			float m_fps = 0.0f;
+			PhysicsRigLanes m_lanes;
 		};
 
 		/**
-		 * @brief Controls the physics of a ModelInstance
+		 * @brief Controls the physics of a ModelInstance. The settings are shared through the PhysicsRig of the Model,
+		 * the controller itself only holds the node positions, velocities and gravity of the simulation in a single
+		 * allocation.
 		*/
 		class PhysicsController {
 		public:
-			PhysicsController(const char* filepath);
+			/**
+			 * @param rig The physics settings, this pointer has to stay valid throughout the lifespan of the controller
+			*/
+			explicit PhysicsController(const PhysicsRig* rig);
 
 			/**
 			 * @brief Attaches this PhysicsController to a ModelInstance, so when you call update() on this
@@ -119,17 +263,190 @@ namespace luna {
 			 * @brief Stabilizes the PhysicsController, that is putting it in a state where it is stable and all
 			 * forces cancel out so there will be no movement coming from the physics until one of the input
 			 * parameters changes. It might make sense to call this after changing the model's parameters in a
-			 * non-continuous way to avoid a sudden jerk in the physics.
+			 * non-continuous way to avoid a sudden jerk in the physics. This is a single pass over all the nodes, so a
+			 * freshly spawned instance can be settled without running any warm-up updates.
 			*/
 			void stabilize();
 
-			size_t getGroupCount();
-			PhysicsGroup* getGroups();
-			const PhysicsGroup* getGroups() const;
+			/**
+			 * @brief Puts all the pendulums back in their initial position
+			*/
+			void reset();
+
+			/**
+			 * @brief Selects the implementation that is used to run the simulation, the state carries over
+			 * @param kernel The kernel to use from now on
+			*/
+			void setKernel(PhysicsKernel kernel);
+			PhysicsKernel getKernel() const;
+
+			/**
+			 * @brief Enables the fixed-step mode. Instead of integrating once per update() with the frame time, the
+			 * simulation then advances in fixed steps at the rate of PhysicsRig::getFps() (30 steps per second if the
+			 * file doesn't specify it), and the outputs are interpolated between the last two steps. This keeps the
+			 * cost of the physics independent of the frame rate and keeps long frames from destabilizing the pendulums,
+			 * at the cost of showing the physics up to one step late.
+			*/
+			void setFixedStep(bool enabled);
+			bool isFixedStep() const;
+
+			/**
+			 * @brief Lets groups fall asleep when their inputs did not move since the last update and all of their nodes
+			 * are slow and close to their rest pose. A sleeping group is not simulated and does not write its outputs, until
+			 * one of its inputs moves away from the value it fell asleep with. All thresholds are 0.001 times the maximum of
+			 * the normalization parameters of the group, like the threshold that stops the pendulums.
+			*/
+			void setSleepEnabled(bool enabled);
+			bool isSleepEnabled() const;
+
+			/**
+			 * @return The amount of groups that were simulated during the last update()
+			*/
+			size_t getAwakeGroupCount() const;
+
+			const PhysicsRig* getRig() const;
+
+			/**
+			 * @param group The index of the group
+			 * @return The simulation state of that group
+			*/
+			PhysicsGroupState getGroupState(size_t group);
+
+			/**
+			 * @return The positions of all the nodes, indexed by PhysicsGroup::getFirstNode() + the node index
+			*/
+			const glm::vec2* getNodePositions() const;
+
+			/**
+			 * @return The velocities of all the nodes, indexed by PhysicsGroup::getFirstNode() + the node index
+			*/
+			const glm::vec2* getNodeVelocities() const;
 
 		private:
-			std::vector<PhysicsGroup> m_groups;
+			struct GroupInputs {
+				float rotation = 0.0f;
+				glm::vec2 position = glm::vec2(0.0f);
+				bool awake = true;
+				bool moved = true;
+			};
+
+			bool wake(size_t group, float rotation, glm::vec2 position);
+			void settle(size_t group);
+			void wakeAll();
+			void readInputs();
+			float getStepTime() const;
+			void step(float deltatime);
+			void writeOutputs(glm::vec2* positions);
+			void stepSimd(float deltatime);
+			void gatherLanes();
+			void scatterLanes();
+
+		private:
+			const PhysicsRig* m_rig;
+			ModelInstance* m_instance = nullptr;
+
+			std::unique_ptr<glm::vec2[]> m_state;
+			glm::vec2* m_positions = nullptr;
+			glm::vec2* m_velocities = nullptr;
+			glm::vec2* m_prevPositions = nullptr;
+			glm::vec2* m_interpolatedPositions = nullptr;
+			glm::vec2* m_prevGravity = nullptr;
+
+			bool m_fixedStep = false;
+			float m_accumulator = 0.0f;
+
+			// the inputs of every group as of its last step, which decide whether it sleeps
+			std::vector<GroupInputs> m_groupInputs;
+			bool m_sleepEnabled = false;
+			size_t m_awakeGroupCount = 0;
+
+			// structure-of-arrays state for the SIMD kernel, laid out like PhysicsRigLanes
+			PhysicsKernel m_kernel = PhysicsKernel::Scalar;
+			std::unique_ptr<float[]> m_laneState;
+			float* m_lanePositionX = nullptr;
+			float* m_lanePositionY = nullptr;
+			float* m_laneVelocityX = nullptr;
+			float* m_laneVelocityY = nullptr;
+			float* m_laneGravityX = nullptr;
+			float* m_laneGravityY = nullptr;
+			float* m_lanePrevGravityX = nullptr;
+			float* m_lanePrevGravityY = nullptr;
+			float* m_laneAwake = nullptr;
+			bool m_lanesOutdated = true;
+		};
+
+		/**
+		 * @brief Simulates the physics of many ModelInstances of the same Model in a single pass. The state is stored
+		 * instance-major, node n of instance k lives at index n * laneCount + k, so every SIMD lane is a different
+		 * instance and the node constants are shared by the whole vector. The results are written straight to the
+		 * parameters of every instance.
+		 * While an instance is part of a batch its own PhysicsController is detached, so ModelInstance::update()
+		 * leaves the physics to the batch. Removing the instance hands the state back to its controller.
+		*/
+		class PhysicsBatch {
+		public:
+			/**
+			 * @param model The Model that all the instances in this batch share, this pointer has to stay valid
+			 * throughout the lifespan of the batch
+			*/
+			explicit PhysicsBatch(const Model* model);
+			PhysicsBatch(PhysicsBatch&) = delete;
+			PhysicsBatch& operator=(PhysicsBatch&) = delete;
+			PhysicsBatch(PhysicsBatch&&) = delete;
+			PhysicsBatch& operator=(PhysicsBatch&&) = delete;
+			~PhysicsBatch();
+
+			/**
+			 * @brief Adds an instance to the batch, the simulation continues from the state of its PhysicsController
+			 * @param instance An instance of the Model of this batch, it has to stay valid until it is removed again
+			 * @return False if the instance does not belong to the Model of this batch or has no physics
+			*/
+			bool add(ModelInstance* instance);
+
+			/**
+			 * @brief Removes an instance from the batch and reattaches its PhysicsController
+			*/
+			void remove(ModelInstance* instance);
+
+			/**
+			 * @brief Updates the physics of all the instances and writes to the values of all the connected parameters
+			*/
+			void update(float deltatime);
+
+			/**
+			 * @brief Puts the pendulums of all the instances in their rest pose, see PhysicsController::stabilize()
+			*/
+			void stabilize();
+
+			/**
+			 * @brief Puts the pendulums of all the instances back in their initial position
+			*/
+			void reset();
+
+			size_t getInstanceCount() const;
+			ModelInstance* const* getInstances() const;
+
+		private:
+			void storeState();
+			void loadState();
+
+		private:
+			const Model* m_model;
+			const PhysicsRig* m_rig;
+			std::vector<ModelInstance*> m_instances;
+
+			// the instances padded to the SIMD width, the padding lanes simulate a pendulum at rest
+			size_t m_laneCount = 0;
+			std::vector<float> m_state;
+			float* m_positionX = nullptr;
+			float* m_positionY = nullptr;
+			float* m_velocityX = nullptr;
+			float* m_velocityY = nullptr;
+			float* m_gravityX = nullptr;
+			float* m_gravityY = nullptr;
+			float* m_prevGravityX = nullptr;
+			float* m_prevGravityY = nullptr;
 		};
 
 	}
-}
\ No newline at end of file
+}
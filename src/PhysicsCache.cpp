@@ -0,0 +1,310 @@
+#include "PhysicsCache.hpp"
+
+#include <cstddef>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <unordered_map>
+
+#include "MappedFile.hpp"
+
+namespace luna {
+	namespace live2d {
+
+		namespace {
+			constexpr char Magic[4] = { 'L', 'P', 'H', 'Y' };
+
+			// every record is a multiple of 4 bytes, so the whole file stays 4 byte aligned
+			struct Header {
+				char magic[4];
+				uint32_t version;
+				uint64_t sourceHash;
+				uint64_t sourceSize;
+				int64_t sourceTime;
+				uint32_t groupCount;
+				uint32_t inputCount;
+				uint32_t outputCount;
+				uint32_t nodeCount;
+				uint32_t idCount;
+				uint32_t idDataSize;
+				float fps;
+				uint32_t padding;
+			};
+
+			struct GroupRecord {
+				uint32_t id;
+				uint32_t firstInput;
+				uint32_t inputCount;
+				uint32_t firstOutput;
+				uint32_t outputCount;
+				uint32_t firstNode;
+				uint32_t nodeCount;
+				NormalizationParams positionNormalization;
+				NormalizationParams angleNormalization;
+			};
+
+			struct InputRecord {
+				uint32_t paramId;
+				uint8_t type;
+				uint8_t reflect;
+				uint16_t padding;
+				float weight;
+			};
+
+			struct OutputRecord {
+				uint32_t paramId;
+				uint8_t type;
+				uint8_t reflect;
+				uint16_t padding;
+				int32_t pendulumNodeIndex;
+				float weight;
+				float scale;
+			};
+
+			struct NodeRecord {
+				float initialPositionX;
+				float initialPositionY;
+				float mobility;
+				float delay;
+				float acceleration;
+				float radius;
+			};
+
+			// the size and modification time of a file, without reading it
+			bool statFile(const char* path, uint64_t& size, int64_t& time) {
+				std::error_code error;
+				size = std::filesystem::file_size(path, error);
+				if (error)
+					return false;
+
+				time = int64_t(std::filesystem::last_write_time(path, error).time_since_epoch().count());
+				return !error;
+			}
+
+			// rewrites the source time in the header of a cache file, failing is fine since it only costs a hash next time
+			void stampSourceTime(const char* cachePath, int64_t time) {
+				std::fstream file(cachePath, std::ios::binary | std::ios::in | std::ios::out);
+				if (file.fail())
+					return;
+
+				file.seekp(std::streamoff(offsetof(Header, sourceTime)));
+				file.write(reinterpret_cast<const char*>(&time), sizeof(time));
+			}
+
+			bool hashFile(const char* path, uint64_t& hash, uint64_t& size) {
+				std::ifstream file(path, std::ios::binary);
+				if (file.fail())
+					return false;
+
+				std::vector<char> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+				// FNV-1a
+				hash = 14695981039346656037ull;
+				for (char c : data) {
+					hash ^= uint8_t(c);
+					hash *= 1099511628211ull;
+				}
+
+				size = data.size();
+				return true;
+			}
+
+			template<typename T>
+			const T* readRecords(const char*& cursor, const char* end, size_t count) {
+				if (size_t(end - cursor) < sizeof(T) * count)
+					return nullptr;
+
+				const T* records = reinterpret_cast<const T*>(cursor);
+				cursor += sizeof(T) * count;
+				return records;
+			}
+
+			template<typename T>
+			void writeRecords(std::ofstream& file, const std::vector<T>& records) {
+				file.write(reinterpret_cast<const char*>(records.data()), std::streamsize(sizeof(T) * records.size()));
+			}
+		}
+
+		std::string PhysicsCache::getCachePath(const char* sourcePath) {
+			std::string path = sourcePath;
+			const char* extension = ".json";
+			if (path.size() > 5 && path.compare(path.size() - 5, 5, extension) == 0)
+				path.resize(path.size() - 5);
+			return path + ".bin";
+		}
+
+		std::unique_ptr<PhysicsRig> PhysicsCache::read(const char* cachePath, const char* sourcePath) {
+			if (!std::filesystem::exists(cachePath))
+				return nullptr;
+
+			MappedFile file(cachePath);
+			if (!file.isValid())
+				return nullptr;
+
+			const char* cursor = static_cast<const char*>(file.getData());
+			const char* end = cursor + file.getSize();
+
+			// check if the cache is valid and up to date
+			const Header* header = readRecords<Header>(cursor, end, 1);
+			if (!header || std::memcmp(header->magic, Magic, sizeof(Magic)) != 0 || header->version != Version)
+				return nullptr;
+
+			// only hash the source when it looks like it changed, reading it is what the cache is there to avoid
+			uint64_t sourceHash, sourceSize;
+			int64_t sourceTime;
+			bool restamp = false;
+			if (sourcePath && statFile(sourcePath, sourceSize, sourceTime) && (sourceSize != header->sourceSize || sourceTime != header->sourceTime)) {
+				if (hashFile(sourcePath, sourceHash, sourceSize)) {
+					if (sourceHash != header->sourceHash || sourceSize != header->sourceSize)
+						return nullptr;
+
+					// the source was touched (by a checkout or a copy) without changing, remember its new time
+					restamp = true;
+				}
+			}
+
+			const GroupRecord* groupRecords = readRecords<GroupRecord>(cursor, end, header->groupCount);
+			const InputRecord* inputRecords = readRecords<InputRecord>(cursor, end, header->inputCount);
+			const OutputRecord* outputRecords = readRecords<OutputRecord>(cursor, end, header->outputCount);
+			const NodeRecord* nodeRecords = readRecords<NodeRecord>(cursor, end, header->nodeCount);
+			const uint32_t* idOffsets = readRecords<uint32_t>(cursor, end, header->idCount);
+			const char* idData = readRecords<char>(cursor, end, header->idDataSize);
+			if (!groupRecords || !inputRecords || !outputRecords || !nodeRecords || !idOffsets || !idData || (header->idDataSize > 0 && idData[header->idDataSize - 1] != '\0')) {
+				log("Physics cache is malformed (" + std::string(cachePath) + ")", MessageSeverity::Warning);
+				return nullptr;
+			}
+
+			auto getId = [&](uint32_t index) {
+				return index < header->idCount && idOffsets[index] < header->idDataSize ? idData + idOffsets[index] : "";
+			};
+
+			// rebuild the groups
+			std::vector<PhysicsGroup> groups;
+			groups.reserve(header->groupCount);
+			for (uint32_t i = 0; i < header->groupCount; ++i) {
+				const GroupRecord& group = groupRecords[i];
+				if (uint64_t(group.firstInput) + group.inputCount > header->inputCount ||
+					uint64_t(group.firstOutput) + group.outputCount > header->outputCount ||
+					uint64_t(group.firstNode) + group.nodeCount > header->nodeCount) {
+					log("Physics cache is malformed (" + std::string(cachePath) + ")", MessageSeverity::Warning);
+					return nullptr;
+				}
+
+				std::vector<PhysicsInput> inputs;
+				inputs.reserve(group.inputCount);
+				for (const auto* input = inputRecords + group.firstInput; input != inputRecords + group.firstInput + group.inputCount; ++input)
+					inputs.push_back(PhysicsInput{ getId(input->paramId), PhysicsParameterType(input->type), input->weight, bool(input->reflect), ParameterHandle{} });
+
+				std::vector<PhysicsOutput> outputs;
+				outputs.reserve(group.outputCount);
+				for (const auto* output = outputRecords + group.firstOutput; output != outputRecords + group.firstOutput + group.outputCount; ++output)
+					outputs.push_back(PhysicsOutput{ getId(output->paramId), PhysicsParameterType(output->type), output->pendulumNodeIndex, output->weight, output->scale, bool(output->reflect), ParameterHandle{} });
+
+				std::vector<PhysicsPendulumNode> nodes;
+				nodes.reserve(group.nodeCount);
+				for (const auto* vertex = nodeRecords + group.firstNode; vertex != nodeRecords + group.firstNode + group.nodeCount; ++vertex) {
+					PhysicsPendulumNode node;
+					node.initialPosition = glm::vec2(vertex->initialPositionX, vertex->initialPositionY);
+					node.mobility = vertex->mobility;
+					node.delay = vertex->delay;
+					node.acceleration = vertex->acceleration;
+					node.radius = vertex->radius;
+					nodes.push_back(node);
+				}
+
+				groups.emplace_back(getId(group.id), group.positionNormalization, group.angleNormalization, std::move(nodes), std::move(inputs), std::move(outputs));
+			}
+
+			auto rig = std::make_unique<PhysicsRig>(std::move(groups), header->fps);
+
+			// the mapping has to go before the file can be written to, on Windows a mapped file can't be opened for writing
+			if (restamp) {
+				file = MappedFile();
+				stampSourceTime(cachePath, sourceTime);
+			}
+
+			return rig;
+		}
+
+		bool PhysicsCache::write(const PhysicsRig& rig, const char* sourcePath, const char* cachePath) {
+			Header header = {};
+			std::memcpy(header.magic, Magic, sizeof(Magic));
+			header.version = Version;
+			if (!hashFile(sourcePath, header.sourceHash, header.sourceSize) || !statFile(sourcePath, header.sourceSize, header.sourceTime)) {
+				log("Could not open file at \"" + std::string(sourcePath) + "\"", MessageSeverity::Error);
+				return false;
+			}
+
+			std::vector<GroupRecord> groupRecords;
+			std::vector<InputRecord> inputRecords;
+			std::vector<OutputRecord> outputRecords;
+			std::vector<NodeRecord> nodeRecords;
+			std::vector<uint32_t> idOffsets;
+			std::vector<char> idData;
+
+			// every distinct id is only stored once
+			std::unordered_map<std::string, uint32_t> idIndices;
+			auto internId = [&](const std::string& id) {
+				auto [it, inserted] = idIndices.try_emplace(id, uint32_t(idOffsets.size()));
+				if (inserted) {
+					idOffsets.push_back(uint32_t(idData.size()));
+					idData.insert(idData.end(), id.c_str(), id.c_str() + id.size() + 1);
+				}
+				return it->second;
+			};
+
+			for (size_t i = 0; i < rig.getGroupCount(); ++i) {
+				const PhysicsGroup& group = rig.getGroups()[i];
+
+				GroupRecord groupRecord = {};
+				groupRecord.id = internId(group.getId());
+				groupRecord.firstInput = uint32_t(inputRecords.size());
+				groupRecord.inputCount = uint32_t(group.getInputs().size());
+				groupRecord.firstOutput = uint32_t(outputRecords.size());
+				groupRecord.outputCount = uint32_t(group.getOutputs().size());
+				groupRecord.firstNode = uint32_t(nodeRecords.size());
+				groupRecord.nodeCount = uint32_t(group.getNodeCount());
+				groupRecord.positionNormalization = group.getPositionNormalizationParams();
+				groupRecord.angleNormalization = group.getAngleNormalizationParams();
+				groupRecords.push_back(groupRecord);
+
+				for (const auto& input : group.getInputs())
+					inputRecords.push_back(InputRecord{ internId(input.paramId), uint8_t(input.type), uint8_t(input.reflect), 0, input.weight });
+
+				for (const auto& output : group.getOutputs())
+					outputRecords.push_back(OutputRecord{ internId(output.paramId), uint8_t(output.type), uint8_t(output.reflect), 0, output.pendulumNodeIndex, output.weight, output.scale });
+
+				for (size_t j = 0; j < group.getNodeCount(); ++j) {
+					const PhysicsPendulumNode& node = group.getNodes()[j];
+					nodeRecords.push_back(NodeRecord{ node.initialPosition.x, node.initialPosition.y, node.mobility, node.delay, node.acceleration, node.radius });
+				}
+			}
+
+			header.groupCount = uint32_t(groupRecords.size());
+			header.inputCount = uint32_t(inputRecords.size());
+			header.outputCount = uint32_t(outputRecords.size());
+			header.nodeCount = uint32_t(nodeRecords.size());
+			header.idCount = uint32_t(idOffsets.size());
+			header.idDataSize = uint32_t(idData.size());
+			header.fps = rig.getFps();
+
+			std::ofstream file(cachePath, std::ios::binary | std::ios::trunc);
+			if (file.fail()) {
+				log("Could not open file at \"" + std::string(cachePath) + "\"", MessageSeverity::Error);
+				return false;
+			}
+
+			file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+			writeRecords(file, groupRecords);
+			writeRecords(file, inputRecords);
+			writeRecords(file, outputRecords);
+			writeRecords(file, nodeRecords);
+			writeRecords(file, idOffsets);
+			writeRecords(file, idData);
+
+			return !file.fail();
+		}
+
+	}
+}
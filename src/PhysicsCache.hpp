@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "Physics.hpp"
+
+namespace luna {
+	namespace live2d {
+
+		/**
+		 * @brief Reads and writes the precompiled binary version of a .physics3.json file. The binary file is a flat,
+		 * versioned blob with fixed-size records and an interned id table, so it can be read straight from a memory
+		 * mapping without parsing any JSON. The records are stored in the byte order of the host that wrote them, a cache
+		 * written on a host with the other byte order fails the version check and is ignored.
+		 *
+		 * The cache stores the size, modification time and hash of the .physics3.json file it was built from. As long
+		 * as the size and time still match, the cache is used without opening the source file at all. Only when they
+		 * differ is the source hashed, so a cache that has gone out of date is never used.
+		*/
+		class PhysicsCache {
+		public:
+			static constexpr uint32_t Version = 3;
+
+			/**
+			 * @param sourcePath The path to the .physics3.json file
+			 * @return The path where the cache of that file is stored (the same path with a .physics3.bin extension)
+			*/
+			static std::string getCachePath(const char* sourcePath);
+
+			/**
+			 * @brief Loads a PhysicsRig from a cache file
+			 * @param cachePath The path to the cache file
+			 * @param sourcePath The path to the .physics3.json the cache was built from. When that file exists and
+			 * does not match the cache anymore, the cache is rejected. Can be nullptr to skip this check.
+			 * @return The PhysicsRig, or nullptr when the cache is missing, outdated or malformed
+			*/
+			static std::unique_ptr<PhysicsRig> read(const char* cachePath, const char* sourcePath);
+
+			/**
+			 * @brief Writes a PhysicsRig to a cache file
+			 * @param rig The PhysicsRig, loaded from sourcePath
+			 * @param sourcePath The path to the .physics3.json file that the rig was loaded from
+			 * @param cachePath The path to write the cache file to
+			 * @return True if the file was written successfully
+			*/
+			static bool write(const PhysicsRig& rig, const char* sourcePath, const char* cachePath);
+
+		private:
+			PhysicsCache() = default;
+		};
+
+	}
+}
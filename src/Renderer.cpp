@@ -1,6 +1,12 @@
 #include "Renderer.hpp"
 
+#include <algorithm>
+#include <cmath>
+
 #include "ModelInstance.hpp"
+#include "Simd.hpp"
+#include "ThreadPool.hpp"
+#include "VertexKernels.hpp"
 
 namespace luna {
 	namespace live2d {
@@ -21,55 +27,132 @@ namespace luna {
 		void Renderer::beginFrame() {}
 
 		void Renderer::endFrame() {
+			m_stats = {};
+			if (!m_model)
+				return;
+
+			// one pass over the flags of all drawables, which also marks the batches that need new vertices
+			csmFlags changed = summarizeFlags();
+
 			// check if batches need to be rebuild
-			if (checkRebuild())
+			switch (checkRebuild(changed)) {
+			case Rebuild::Full:
 				sortDrawables();
+				return; // every mesh was just rebuilt
+			case Rebuild::Order:
+				resortDrawables();
+				summarizeFlags(); // the batches moved around
+				break;
+			case Rebuild::None:
+				break;
+			}
 
-			// only rebuild meshes that had a drawable update
-			for (auto& batch : batches) {
-				for (const auto* drawable : batch.drawables) {
-					if (drawable->getDynamicFlags() & 0b1100110) {
-						buildMeshVertices(batch, false);
-						break;
-					}
-				}
+			// nothing that affects the vertices changed
+			if (m_dirtyUpdates.empty())
+				return;
+
+			// every batch, including the mask batches, has its own staging memory, so they can be repacked independently
+			if (m_threadPool && m_dirtyUpdates.size() > 1) {
+				m_threadPool->parallelFor(m_dirtyUpdates.size(), [this](size_t i) {
+					updateMeshVertices(m_batchUpdates[m_dirtyUpdates[i]]);
+				});
+			} else {
+				for (uint32_t updateIdx : m_dirtyUpdates)
+					updateMeshVertices(m_batchUpdates[updateIdx]);
 			}
 
-			// same thing for mask batches
-			for (auto& maskBatchVec : maskBatches) {
-				for (auto& batch : maskBatchVec) {
-					for (const auto* drawable : batch.drawables) {
-						if (drawable->getDynamicFlags() & 0b100110) {
-							buildMeshVertices(batch, true);
-							break;
-						}
-					}
-				}
+			// the uploads have to happen on the render thread
+			for (uint32_t updateIdx : m_dirtyUpdates) {
+				const BatchUpdate& update = m_batchUpdates[updateIdx];
+				if (update.repackedVertices == 0)
+					continue;
+
+				m_stats.repackedVertices += update.repackedVertices;
+				m_stats.repackedBytes += update.repackedBytes;
+				uploadMeshVertices(*update.batch);
 			}
 		}
 
+		void Renderer::setThreadPool(ThreadPool* pool) {
+			m_threadPool = pool;
+		}
+
+		ThreadPool* Renderer::getThreadPool() const {
+			return m_threadPool;
+		}
+
+		void Renderer::setMaskMode(MaskMode mode) {
+			m_maskMode = mode;
+		}
+
+		MaskMode Renderer::getMaskMode() const {
+			return m_maskMode;
+		}
+
+		void Renderer::setMaskResolutionScale(float scale) {
+			m_maskResolutionScale = scale;
+		}
+
+		float Renderer::getMaskResolutionScale() const {
+			return m_maskResolutionScale;
+		}
+
+		void Renderer::setMaskAtlasSize(unsigned int size) {
+			m_maskAtlasSize = size;
+		}
+
+		unsigned int Renderer::getMaskAtlasSize() const {
+			return m_maskAtlasSize;
+		}
+
 		void Renderer::render(const luna::Camera& camera) {
 			if (!camera.getTarget() || !m_model)
 				return;
 
+			glm::mat4 modelMatrix = m_model->getTransform().matrix();
+			glm::mat4 mvp = camera.projection() * camera.getTransform().inverseMatrix() * modelMatrix;
+
+			// the atlas only works when every shader can map the masks into a cell
+			bool fitted = checkMaskShaders();
+			if (m_maskMode == MaskMode::Atlas && fitted) {
+				renderMaskAtlas(camera, modelMatrix, mvp);
+				return;
+			}
+
 			// setup
-			auto maskTexture = luna::getTempRenderTexture(camera.getTarget()->getSize());
+			glm::vec2 maskSize = camera.getTarget()->getSize() * m_maskResolutionScale;
+			auto maskTexture = luna::getTempRenderTexture(maskSize);
 			camera.getTarget()->makeActiveTarget();
 			luna::uploadCameraMatrices(camera.projection(), camera.getTransform().inverseMatrix());
-			glm::mat4 modelMatrix = m_model->getTransform().matrix();
 
 			// rendering
+			size_t currentMask = size_t(-1);
+			MaskMapping mapping;
 			for (auto& batch : batches) {
 				if (batch.maskIdx != size_t(-1)) {
-					// batch has mask
-					maskTexture->makeActiveTarget();
-					luna::RenderTarget::clear(luna::Color::Clear);
+					// batch has mask, which might still be in the mask texture from a previous batch
+					if (batch.maskIdx != currentMask) {
+						// the bounds of the masks get stretched over the whole mask texture, unless a shader of the
+						// set doesn't declare the mask uniforms and expects the masks at their place on the screen
+						bool visible = true;
+						if (m_maskFitted[batch.maskIdx])
+							visible = computeMaskMapping(batch.maskIdx, mvp, glm::vec2(0.0f), glm::vec2(1.0f), maskSize, mapping);
+						else
+							mapping = MaskMapping();
+
+						maskTexture->makeActiveTarget();
+						luna::RenderTarget::clear(luna::Color::Clear);
+
+						if (visible) {
+							for (auto& maskBatch : maskBatches[batch.maskIdx])
+								drawBatch(maskBatch, modelMatrix, nullptr, false, &mapping);
+						}
 
-					for (auto& maskBatch : maskBatches[batch.maskIdx])
-						drawBatch(maskBatch, modelMatrix);
+						camera.getTarget()->makeActiveTarget();
+						currentMask = batch.maskIdx;
+					}
 
-					camera.getTarget()->makeActiveTarget();
-					drawBatch(batch, modelMatrix, &*maskTexture, bool(batch.drawables.front()->getConstantFlags() & 0b1000));
+					drawBatch(batch, modelMatrix, &*maskTexture, bool(batch.drawables.front()->getConstantFlags() & 0b1000), &mapping);
 				} else {
 					// no mask, just render regularly
 					drawBatch(batch, modelMatrix);
@@ -77,18 +160,227 @@ namespace luna {
 			}
 		}
 
-		bool Renderer::checkRebuild() {
+		void Renderer::renderMaskAtlas(const luna::Camera& camera, const glm::mat4& modelMatrix, const glm::mat4& mvp) {
+			glm::vec2 atlasSize = glm::vec2(float(m_maskAtlasSize));
+			auto atlas = luna::getTempRenderTexture(atlasSize);
+			luna::uploadCameraMatrices(camera.projection(), camera.getTransform().inverseMatrix());
+
+			// draw every mask set into its own cell, with a single clear
+			m_maskMappings.resize(maskBatches.size());
+			if (!maskBatches.empty()) {
+				atlas->makeActiveTarget();
+				luna::RenderTarget::clear(luna::Color::Clear);
+
+				// the atlas is split up in a grid, with a cell for every mask set
+				size_t columns = size_t(std::ceil(std::sqrt(double(maskBatches.size()))));
+				size_t rows = (maskBatches.size() + columns - 1) / columns;
+				glm::vec2 cellSize(1.0f / float(columns), 1.0f / float(rows));
+
+				for (size_t i = 0; i < maskBatches.size(); ++i) {
+					glm::vec2 cellMin = glm::vec2(float(i % columns), float(i / columns)) * cellSize;
+					if (!computeMaskMapping(i, mvp, cellMin, cellMin + cellSize, atlasSize, m_maskMappings[i]))
+						continue;
+
+					for (auto& maskBatch : maskBatches[i])
+						drawBatch(maskBatch, modelMatrix, nullptr, false, &m_maskMappings[i]);
+				}
+			}
+
+			// rendering
+			camera.getTarget()->makeActiveTarget();
+			for (auto& batch : batches) {
+				if (batch.maskIdx != size_t(-1))
+					drawBatch(batch, modelMatrix, &*atlas, bool(batch.drawables.front()->getConstantFlags() & 0b1000), &m_maskMappings[batch.maskIdx]);
+				else
+					drawBatch(batch, modelMatrix);
+			}
+		}
+
+		bool Renderer::checkMaskShaders() {
+			auto declares = [](const Batch& batch, const char* uniform) {
+				return batch.drawables.front()->getMaterial()->getShader()->getProgram().uniformId(uniform) != -1;
+			};
+
+			// a mask set can only be fitted when the shaders drawing the masks and the ones sampling them all know about it
+			bool fitted = true;
+			m_maskFitted.assign(maskBatches.size(), 1);
+			for (size_t i = 0; i < maskBatches.size(); ++i) {
+				for (auto& maskBatch : maskBatches[i]) {
+					if (!declares(maskBatch, "Live2DMaskTarget"))
+						m_maskFitted[i] = 0;
+				}
+			}
+			for (auto& batch : batches) {
+				if (batch.maskIdx != size_t(-1) && !declares(batch, "Live2DMaskRegion"))
+					m_maskFitted[batch.maskIdx] = 0;
+			}
+
+			for (uint8_t maskFitted : m_maskFitted)
+				fitted &= bool(maskFitted);
+			return fitted;
+		}
+
+		bool Renderer::computeMaskMapping(size_t maskIdx, const glm::mat4& mvp, glm::vec2 cellMin, glm::vec2 cellMax, glm::vec2 textureSize, MaskMapping& mapping) const {
+			// screen space bounds of all the masks in the set
+			glm::vec2 boundsMin(1.0f);
+			glm::vec2 boundsMax(-1.0f);
+			bool behindCamera = false;
+
+			for (auto& maskBatch : maskBatches[maskIdx]) {
+				for (const auto* drawable : maskBatch.drawables) {
+					for (size_t i = 0; i < drawable->getVertexCount(); ++i) {
+						glm::vec4 clip = mvp * glm::vec4(drawable->getVertexPositions()[i], 0.0f, 1.0f);
+						if (clip.w <= 0.0f) {
+							behindCamera = true;
+							continue;
+						}
+
+						glm::vec2 ndc = glm::vec2(clip.x, clip.y) / clip.w;
+						boundsMin = glm::min(boundsMin, ndc);
+						boundsMax = glm::max(boundsMax, ndc);
+					}
+				}
+			}
+
+			// projecting vertices behind the camera doesn't give usable bounds, so fall back to the whole screen
+			if (behindCamera) {
+				boundsMin = glm::vec2(-1.0f);
+				boundsMax = glm::vec2(1.0f);
+			}
+
+			boundsMin = glm::max(boundsMin, glm::vec2(-1.0f));
+			boundsMax = glm::min(boundsMax, glm::vec2(1.0f));
+			bool visible = boundsMin.x < boundsMax.x && boundsMin.y < boundsMax.y;
+			if (!visible) {
+				boundsMin = glm::vec2(-1.0f);
+				boundsMax = glm::vec2(1.0f);
+			}
+
+			// the bounds are fitted inside the cell with a two texel border, sampling gets clamped to one texel
+			// inside of the cell, so the edges always read an empty mask and never the neighbouring cells
+			glm::vec2 texel = 1.0f / textureSize;
+			glm::vec2 fitMin = cellMin + 2.0f * texel;
+			glm::vec2 fitMax = cellMax - 2.0f * texel;
+
+			// clip space to the fitted area, in clip space of the mask texture
+			glm::vec2 scale = (fitMax - fitMin) / (boundsMax - boundsMin);
+			mapping.target = glm::vec4(2.0f * scale, 2.0f * fitMin - 1.0f - 2.0f * scale * boundsMin);
+
+			// screen uv to mask texture uv, screen uv is (ndc + 1) / 2
+			mapping.region = glm::vec4(2.0f * scale, fitMin - scale * (boundsMin + 1.0f));
+			mapping.bounds = glm::vec4(cellMin + texel, cellMax - texel);
+
+			return visible;
+		}
+
+		const RendererStats& Renderer::getStats() const {
+			return m_stats;
+		}
+
+		Renderer::Rebuild Renderer::checkRebuild(csmFlags changed) {
+			// materials aren't part of the flags, but they are stored in the drawables themselves
 			for (auto& batch : batches) {
 				for (const auto* drawable : batch.drawables) {
 					if (batch.drawables.front()->getMaterial() != drawable->getMaterial())
-						return true; // rebuild when material changed
+						return Rebuild::Full; // rebuild when material changed
+				}
+			}
+
+			if (changed & 0b11000)
+				return Rebuild::Order; // resort when the draw order or render order changed
 
-					if (drawable->getDynamicFlags() & 0b1000) 
-						return true; // rebuild when render order changed
+			return Rebuild::None;
+		}
+
+		csmFlags Renderer::summarizeFlags() {
+			const csmFlags* flags = m_model->getDynamicFlags();
+			size_t count = std::min(m_model->getCoreDrawableCount(), m_flagTargetOffsets.size() - 1);
+			csmFlags changed = 0;
+
+			for (uint32_t updateIdx : m_dirtyUpdates)
+				m_dirtyBatches[updateIdx / 64] &= ~(uint64_t(1) << (updateIdx % 64));
+			m_dirtyUpdates.clear();
+
+			auto mark = [&](size_t i) {
+				// ignore the visibility itself, only the bits that tell something changed matter
+				csmFlags flag = flags[i] & 0b1111110;
+				changed |= flag;
+				if (!(flag & 0b1100110))
+					return;
+
+				for (uint32_t j = m_flagTargetOffsets[i]; j < m_flagTargetOffsets[i + 1]; ++j) {
+					uint32_t updateIdx = m_flagTargets[j];
+					uint64_t bit = uint64_t(1) << (updateIdx % 64);
+					if (!(m_dirtyBatches[updateIdx / 64] & bit)) {
+						m_dirtyBatches[updateIdx / 64] |= bit;
+						m_dirtyUpdates.push_back(updateIdx);
+						m_batchUpdates[updateIdx].repackedVertices = 0;
+						m_batchUpdates[updateIdx].repackedBytes = 0;
+					}
 				}
+			};
+
+			// most flags are 0 (apart from the visibility bit), so skip 16 drawables at a time when none of them changed
+			size_t i = 0;
+#if defined(LUNA_LIVE2D_SIMD_AVX) || defined(LUNA_LIVE2D_SIMD_SSE)
+			const __m128i relevant = _mm_set1_epi8(char(0b1111110));
+			for (; i + 16 <= count; i += 16) {
+				__m128i v = _mm_and_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(flags + i)), relevant);
+				int unchanged = _mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_setzero_si128()));
+				if (unchanged == 0xFFFF)
+					continue;
+
+				for (size_t j = 0; j < 16; ++j) {
+					if (!(unchanged & (1 << j)))
+						mark(i + j);
+				}
+			}
+#elif defined(LUNA_LIVE2D_SIMD_NEON)
+			const uint8x16_t relevant = vdupq_n_u8(0b1111110);
+			for (; i + 16 <= count; i += 16) {
+				if (vmaxvq_u8(vandq_u8(vld1q_u8(flags + i), relevant)) == 0)
+					continue;
+
+				for (size_t j = 0; j < 16; ++j)
+					mark(i + j);
 			}
+#endif
+			for (; i < count; ++i)
+				mark(i);
 
-			return false;
+			return changed;
+		}
+
+		void Renderer::buildUpdateList() {
+			m_batchUpdates.clear();
+			for (auto& batch : batches)
+				m_batchUpdates.push_back({ &batch, false });
+			for (auto& maskBatchVec : maskBatches)
+				for (auto& batch : maskBatchVec)
+					m_batchUpdates.push_back({ &batch, true });
+
+			m_dirtyBatches.assign((m_batchUpdates.size() + 63) / 64, 0);
+			m_dirtyUpdates.clear();
+
+			// for every drawable of the csmModel, the batches it is part of, grouped with a counting sort
+			size_t count = m_model->getCoreDrawableCount();
+			m_flagTargetOffsets.assign(count + 1, 0);
+			for (auto& update : m_batchUpdates)
+				for (const auto* drawable : update.batch->drawables)
+					++m_flagTargetOffsets[getCoreIndex(drawable) + 1];
+
+			for (size_t i = 0; i < count; ++i)
+				m_flagTargetOffsets[i + 1] += m_flagTargetOffsets[i];
+
+			m_flagTargets.resize(m_flagTargetOffsets.back());
+			m_flagTargetCursors.assign(m_flagTargetOffsets.begin(), m_flagTargetOffsets.end() - 1);
+			for (size_t i = 0; i < m_batchUpdates.size(); ++i)
+				for (const auto* drawable : m_batchUpdates[i].batch->drawables)
+					m_flagTargets[m_flagTargetCursors[getCoreIndex(drawable)]++] = uint32_t(i);
+		}
+
+		size_t Renderer::getCoreIndex(const Drawable* drawable) const {
+			return m_model->getCoreDrawableIndex(size_t(drawable - m_model->getDrawables()));
 		}
 
 		void Renderer::sortDrawables() {
@@ -99,45 +391,179 @@ namespace luna {
 			buildBatches(); // rebuild required after sorting
 		}
 
+		void Renderer::resortDrawables() {
+			m_previousDrawables.assign(m_drawables.begin(), m_drawables.end());
+
+			// usually only a couple of drawables moved, insertion sort is linear on an almost sorted list
+			for (size_t i = 1; i < m_drawables.size(); ++i) {
+				const Drawable* drawable = m_drawables[i];
+				size_t j = i;
+				for (; j > 0 && m_drawables[j - 1]->getRenderOrder() > drawable->getRenderOrder(); --j)
+					m_drawables[j] = m_drawables[j - 1];
+				m_drawables[j] = drawable;
+			}
+
+			// find the range of drawables that moved
+			size_t first = 0;
+			while (first < m_drawables.size() && m_drawables[first] == m_previousDrawables[first])
+				++first;
+			if (first == m_drawables.size())
+				return;
+
+			size_t last = m_drawables.size() - 1;
+			while (m_drawables[last] == m_previousDrawables[last])
+				--last;
+
+			// find the batch before the range, the first moved drawable might join it now
+			// the batches partition the drawables in order
+			size_t firstBatch = 0;
+			size_t start = 0;
+			while (start + batches[firstBatch].drawables.size() < std::max(first, size_t(1)))
+				start += batches[firstBatch++].drawables.size();
+
+			// split the drawables up again from the start of that batch, until a new batch starts on the same drawable
+			// as an old batch after the moved range, from there on the old batches are still valid
+			size_t batchCount = 0;
+			size_t oldMaskCount = maskBatches.size();
+			size_t maskCount = oldMaskCount;
+			size_t endBatch = firstBatch;
+			size_t endBatchStart = start;
+
+			Batch* currentBatch = &nextBatch(m_resortBatches, batchCount);
+			if (firstBatch != 0)
+				currentBatch->maskIdx = getMaskSet(*m_drawables[start], maskCount);
+
+			size_t i = start;
+			for (; i < m_drawables.size(); ++i) {
+				const Drawable* drawable = m_drawables[i];
+				if (!fitsInBatch(*currentBatch, *drawable, false)) {
+					while (endBatch < batches.size() && endBatchStart < i)
+						endBatchStart += batches[endBatch++].drawables.size();
+					if (i > last && endBatchStart == i)
+						break;
+
+					currentBatch = &nextBatch(m_resortBatches, batchCount);
+					currentBatch->maskIdx = getMaskSet(*drawable, maskCount);
+				}
+				currentBatch->drawables.push_back(drawable);
+			}
+			if (i == m_drawables.size())
+				endBatch = batches.size();
+
+			// swap the new batches in, reusing the meshes of the old ones
+			size_t oldCount = endBatch - firstBatch;
+			for (size_t j = oldCount; j < batchCount; ++j)
+				batches.emplace(batches.begin() + endBatch);
+			if (batchCount < oldCount)
+				batches.erase(batches.begin() + firstBatch + batchCount, batches.begin() + endBatch);
+
+			for (size_t j = 0; j < batchCount; ++j) {
+				Batch& batch = batches[firstBatch + j];
+				std::swap(batch.drawables, m_resortBatches[j].drawables);
+				batch.maskIdx = m_resortBatches[j].maskIdx;
+
+				buildMeshIndices(batch);
+				buildMeshVertices(batch, false);
+			}
+
+			// mask sets that weren't used before need their meshes
+			for (size_t j = oldMaskCount; j < maskCount; ++j) {
+				for (auto& batch : maskBatches[j]) {
+					buildMeshIndices(batch);
+					buildMeshVertices(batch, true);
+				}
+			}
+
+			compactMaskSets();
+			buildUpdateList();
+		}
+
+		void Renderer::compactMaskSets() {
+			// the moved drawables may have been the last users of a mask set
+			m_maskRemap.assign(maskBatches.size(), size_t(-1));
+			for (const auto& batch : batches) {
+				if (batch.maskIdx != size_t(-1))
+					m_maskRemap[batch.maskIdx] = 0;
+			}
+
+			// move the sets that are still used to the front, in their current order
+			size_t maskCount = 0;
+			for (size_t i = 0; i < maskBatches.size(); ++i) {
+				if (m_maskRemap[i] == size_t(-1))
+					continue;
+
+				if (i != maskCount) {
+					std::swap(maskBatches[maskCount], maskBatches[i]);
+					std::swap(m_maskSets[maskCount], m_maskSets[i]);
+					std::swap(m_maskSetHashes[maskCount], m_maskSetHashes[i]);
+				}
+				m_maskRemap[i] = maskCount++;
+			}
+
+			if (maskCount == maskBatches.size())
+				return;
+
+			maskBatches.resize(maskCount);
+			for (auto& batch : batches) {
+				if (batch.maskIdx != size_t(-1))
+					batch.maskIdx = m_maskRemap[batch.maskIdx];
+			}
+		}
+
+		size_t Renderer::getMaskSet(const Drawable& drawable, size_t& maskCount) {
+			if (drawable.getMaskCount() == 0)
+				return size_t(-1);
+
+			// batches with the same set of masks share a single mask render
+			size_t maskIdx = findMaskSet(drawable, maskCount);
+			if (maskIdx != maskCount)
+				return maskIdx;
+
+			if (maskCount == maskBatches.size())
+				maskBatches.emplace_back();
+			auto& maskBatchVec = maskBatches[maskCount++];
+
+			// set up batches for masking, the masks are in the canonical order of the set
+			size_t maskBatchCount = 0;
+			Batch* currentMaskBatch = &nextBatch(maskBatchVec, maskBatchCount);
+			for (int maskDrawableIdx : m_maskSets[maskIdx]) {
+				const auto& mask = m_model->getDrawables()[maskDrawableIdx];
+				if (!fitsInBatch(*currentMaskBatch, mask, true)) {
+					// new mask element can't be batched with previos ones, so set up new mask batch
+					currentMaskBatch = &nextBatch(maskBatchVec, maskBatchCount);
+				}
+				currentMaskBatch->drawables.push_back(&mask);
+			}
+
+			maskBatchVec.resize(maskBatchCount);
+			return maskIdx;
+		}
+
 		void Renderer::buildBatches() {
-			batches.clear();
-			maskBatches.clear();
+			if (m_drawables.empty()) {
+				batches.clear();
+				maskBatches.clear();
+				buildUpdateList();
+				return;
+			}
 
-			if (m_drawables.empty()) return;
+			// the previous batches are reused, so their vectors keep their capacity
+			size_t batchCount = 0;
+			size_t maskCount = 0;
 
 			// split the drawables up in batches
-			Batch currentBatch;
+			Batch* currentBatch = &nextBatch(batches, batchCount);
 			for (const auto* drawable : m_drawables) {
-				if (!fitsInBatch(currentBatch, *drawable, false)) {
+				if (!fitsInBatch(*currentBatch, *drawable, false)) {
 					// new element can't be batched with previous ones, so set up new batch
-					batches.emplace_back(std::move(currentBatch));
-					currentBatch = {};
-					if (drawable->getMaskCount() != 0) {
-						// new batch has a mask
-						currentBatch.maskIdx = maskBatches.size();
-						maskBatches.emplace_back();
-
-						// set up batches for masking
-						Batch currentMaskBatch;
-						for (size_t i = 0; i < drawable->getMaskCount(); ++i) {
-							int maskDrawableIdx = drawable->getMasks()[i];
-							if (maskDrawableIdx == -1) continue;
-
-							const auto& mask = m_model->getDrawables()[maskDrawableIdx];
-							if (!fitsInBatch(currentMaskBatch, mask, true)) {
-								// new mask element can't be batched with previos ones, so set up new mask batch
-								maskBatches.back().emplace_back(std::move(currentMaskBatch));
-								currentMaskBatch = {};
-							}
-							currentMaskBatch.drawables.push_back(&mask);
-						}
-
-						maskBatches.back().emplace_back(std::move(currentMaskBatch));
-					}
+					currentBatch = &nextBatch(batches, batchCount);
+					currentBatch->maskIdx = getMaskSet(*drawable, maskCount);
 				}
-				currentBatch.drawables.push_back(drawable);
+				currentBatch->drawables.push_back(drawable);
 			}
-			batches.emplace_back(std::move(currentBatch));
+
+			batches.resize(batchCount);
+			maskBatches.resize(maskCount);
 
 			// build meshes for every batch
 			for (auto& batch : batches) {
@@ -151,57 +577,137 @@ namespace luna {
 					buildMeshVertices(batch, true);
 				}
 			}
+
+			buildUpdateList();
+		}
+
+		size_t Renderer::findMaskSet(const Drawable& drawable, size_t maskSetCount) {
+			// the canonical form of a mask set is its sorted list of mask indices
+			m_maskKey.assign(drawable.getMasks(), drawable.getMasks() + drawable.getMaskCount());
+			m_maskKey.erase(std::remove(m_maskKey.begin(), m_maskKey.end(), -1), m_maskKey.end());
+			std::sort(m_maskKey.begin(), m_maskKey.end());
+
+			size_t hash = m_maskKey.size();
+			for (int mask : m_maskKey)
+				hash ^= std::hash<int>()(mask) + 0x9e3779b9 + (hash << 6) + (hash >> 2);
+
+			for (size_t i = 0; i < maskSetCount; ++i) {
+				if (m_maskSetHashes[i] == hash && m_maskSets[i] == m_maskKey)
+					return i;
+			}
+
+			// not seen before, register it as the next mask set
+			if (maskSetCount == m_maskSets.size()) {
+				m_maskSets.emplace_back();
+				m_maskSetHashes.emplace_back();
+			}
+			m_maskSets[maskSetCount] = m_maskKey;
+			m_maskSetHashes[maskSetCount] = hash;
+			return maskSetCount;
+		}
+
+		Renderer::Batch& Renderer::nextBatch(std::vector<Batch>& list, size_t& count) {
+			if (count == list.size())
+				list.emplace_back();
+
+			Batch& batch = list[count++];
+			batch.drawables.clear();
+			batch.maskIdx = size_t(-1);
+			return batch;
 		}
 
 		void Renderer::buildMeshIndices(Batch& batch) {
-			std::vector<unsigned int> indices;
-			unsigned int indexOffset = 0;
 			size_t indexCount = 0;
-			size_t index = 0;
+			unsigned int indexOffset = 0;
 
 			// sum up size of index buffer
 			for (const auto* drawable : batch.drawables)
 				indexCount += drawable->getIndexCount();
-			indices.resize(indexCount);
+			m_indices.resize(indexCount);
 
-			// populate the buffer
+			// populate the buffer, it is reused by every batch so rebuilds don't allocate once it is large enough
+			size_t index = 0;
 			for (const auto* drawable : batch.drawables) {
-				for (size_t i = 0; i < drawable->getIndexCount(); ++i) {
-					indices[index] = drawable->getIndices()[i] + indexOffset;
-					++index;
-				}
-				indexOffset += unsigned int(drawable->getVertexCount());
+				for (size_t i = 0; i < drawable->getIndexCount(); ++i)
+					m_indices[index++] = drawable->getIndices()[i] + indexOffset;
+				indexOffset += static_cast<unsigned int>(drawable->getVertexCount());
 			}
 
-			batch.mesh.setIndices(indices.data(), indices.size());
+			batch.mesh.setIndices(m_indices.data(), m_indices.size());
 		}
 
 		void Renderer::buildMeshVertices(Batch& batch, bool isMask) {
-			std::vector<luna::Vertex> vertices;
 			size_t vertexCount = 0;
-			size_t index = 0;
 
-			// sum up size of vertex buffer
-			for (const auto* drawable : batch.drawables)
-				vertexCount += drawable->getVertexCount();
-			vertices.resize(vertexCount);
+			// every drawable gets a fixed range within the vertex buffer
+			batch.vertexOffsets.resize(batch.drawables.size());
+			for (size_t i = 0; i < batch.drawables.size(); ++i) {
+				batch.vertexOffsets[i] = vertexCount;
+				vertexCount += batch.drawables[i]->getVertexCount();
+			}
+			batch.vertices.resize(vertexCount);
 
 			// populate the buffer
-			for (const auto* drawable : batch.drawables) {
-				uint32_t multCol = isMask ? 0xFFFFFFFF : drawable->getMultiplyColor().compressed();
-				glm::vec3 screenCol = isMask ? glm::vec3(0.0f) : drawable->getScreenColor().vec3();
+			for (size_t i = 0; i < batch.drawables.size(); ++i)
+				writeDrawableVertices(batch, i, isMask);
 
-				for (size_t i = 0; i < drawable->getVertexCount(); ++i) {
-					auto pos = drawable->getVertexPositions()[i];
-					auto uv = drawable->getVertexUvs()[i];
+			m_stats.repackedVertices += vertexCount;
+			m_stats.repackedBytes += vertexCount * sizeof(luna::Vertex);
+			uploadMeshVertices(batch);
+		}
 
-					// passing the screen colour as a normal, its cursed but you gotta spend sauce to make sauce
-					vertices[index] = luna::Vertex(glm::vec3(pos, 0.0f), uv, screenCol, multCol);
-					++index;
+		void Renderer::updateMeshVertices(BatchUpdate& update) {
+			Batch& batch = *update.batch;
+			bool isMask = update.isMask;
+			size_t repacked = 0;
+			size_t repackedBytes = 0;
+
+			for (size_t i = 0; i < batch.drawables.size(); ++i) {
+				const Drawable* drawable = batch.drawables[i];
+				csmFlags flags = drawable->getDynamicFlags();
+
+				if (!isMask && (flags & 0b1000110)) {
+					// visibility, opacity or blend colour changed, the colours need to be repacked
+					writeDrawableVertices(batch, i, isMask);
+					repacked += drawable->getVertexCount();
+					repackedBytes += drawable->getVertexCount() * sizeof(luna::Vertex);
+				} else if (flags & 0b100000) {
+					// only the positions moved, uvs and colours are still in place
+					writeDrawablePositions(batch, i);
+					repacked += drawable->getVertexCount();
+					repackedBytes += drawable->getVertexCount() * sizeof(glm::vec2);
 				}
 			}
 
-			batch.mesh.setVertices(vertices.data(), vertices.size());
+			update.repackedVertices = repacked;
+			update.repackedBytes = repackedBytes;
+		}
+
+		void Renderer::writeDrawableVertices(Batch& batch, size_t drawableIdx, bool isMask) {
+			const Drawable* drawable = batch.drawables[drawableIdx];
+			luna::Vertex* out = batch.vertices.data() + batch.vertexOffsets[drawableIdx];
+
+			uint32_t multCol = isMask ? 0xFFFFFFFF : drawable->getMultiplyColor().compressed();
+			glm::vec3 screenCol = isMask ? glm::vec3(0.0f) : drawable->getScreenColor().vec3();
+
+			// passing the screen colour as a normal, its cursed but you gotta spend sauce to make sauce
+			vertices::write(out, drawable->getVertexPositions(), drawable->getVertexUvs(), drawable->getVertexCount(), screenCol, multCol);
+		}
+
+		void Renderer::writeDrawablePositions(Batch& batch, size_t drawableIdx) {
+			const Drawable* drawable = batch.drawables[drawableIdx];
+			luna::Vertex* out = batch.vertices.data() + batch.vertexOffsets[drawableIdx];
+
+			vertices::writePositions(out, drawable->getVertexPositions(), drawable->getVertexCount());
+		}
+
+		void Renderer::uploadMeshVertices(Batch& batch) {
+			// luna::Mesh can only replace its vertex buffer as a whole, so a batch where only positions moved still
+			// uploads every attribute of every vertex
+			batch.mesh.setVertices(batch.vertices.data(), batch.vertices.size());
+
+			m_stats.uploadedVertices += batch.vertices.size();
+			m_stats.uploadedBytes += batch.vertices.size() * sizeof(luna::Vertex);
 		}
 
 		bool Renderer::fitsInBatch(const Batch& batch, const Drawable& drawable, bool isMask) {
@@ -210,7 +716,11 @@ namespace luna {
 			return false;
 		}
 
-		void Renderer::drawBatch(const Batch& batch, const glm::mat4& modelMatrix, const luna::Texture* mask, bool inverseMask) {
+		void Renderer::drawBatch(const Batch& batch, const glm::mat4& modelMatrix, const luna::Texture* mask, bool inverseMask, const MaskMapping* maskMapping) {
+			static const MaskMapping identity;
+			if (!maskMapping)
+				maskMapping = &identity;
+
 			int texIdx = int(batch.drawables.front()->getMaterial()->getTextureCount());
 			batch.mesh.bind();
 			batch.drawables.front()->getMaterial()->bind();
@@ -218,6 +728,9 @@ namespace luna {
 			shader.uniform(shader.uniformId("ModelMatrix"), modelMatrix);
 			shader.uniform(shader.uniformId("Live2DMaskTexture"), texIdx);
 			shader.uniform(shader.uniformId("Live2DMaskTextureInversed"), int(inverseMask));
+			shader.uniform(shader.uniformId("Live2DMaskRegion"), maskMapping->region);
+			shader.uniform(shader.uniformId("Live2DMaskBounds"), maskMapping->bounds);
+			shader.uniform(shader.uniformId("Live2DMaskTarget"), maskMapping->target);
 			(mask ? *mask : m_noMaskTexture).bind(texIdx);
 
 			draw(&batch.mesh);
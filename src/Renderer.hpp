@@ -8,11 +8,49 @@ namespace luna {
 	namespace live2d {
 
 		class ModelInstance;
+		class ThreadPool;
+
+		/**
+		 * @brief Counters for the vertex data a Renderer wrote during its last endFrame. An animated frame still
+		 * uploads sizeof(luna::Vertex) bytes for every vertex of a changed batch, not just the 8 bytes of its position:
+		 * luna::Mesh takes a single interleaved vertex array and can neither update part of it nor take a separate
+		 * position stream. Only the repacking on the cpu is reduced to the positions.
+		*/
+		struct RendererStats {
+			size_t repackedVertices = 0; // vertices repacked into the cpu copy because their drawable changed
+			size_t repackedBytes = 0; // bytes written to the cpu copy, only positions are written when only positions changed
+			size_t uploadedVertices = 0; // vertices sent to the gpu, always whole batches
+			size_t uploadedBytes = 0; // bytes sent to the gpu, repacking fewer bytes does not shrink this
+		};
+
+		/**
+		 * @brief How a Renderer draws the clipping masks of its batches
+		*/
+		enum class MaskMode : uint8_t {
+			/**
+			 * @brief Every masked batch clears a mask texture and draws its masks into it, right before the batch itself
+			 * is drawn. The screen bounds of the masks are stretched over the mask texture. This needs shaders that declare
+			 * Live2DMaskTarget (for the masks) and Live2DMaskRegion (for the masked drawables), like the built-in one does.
+			 * Mask sets with a shader that doesn't declare them are not fitted, their masks are drawn at their place on the
+			 * screen.
+			*/
+			PerBatch,
+
+			/**
+			 * @brief All masks are drawn once at the start of the frame, every mask set into its own cell of a single
+			 * square atlas. The screen bounds of a mask set are stretched over its cell, so masks only lose resolution
+			 * when they cover a large part of the screen, see Renderer::setMaskAtlasSize. When a shader of any mask set
+			 * doesn't declare the mask uniforms, the frame is drawn as with PerBatch instead.
+			*/
+			Atlas
+		};
 
 		class Renderer : public luna::Renderer {
 		protected:
 			struct Batch {
 				std::vector<const Drawable*> drawables;
+				std::vector<size_t> vertexOffsets; // where every drawable starts in the vertex buffer
+				std::vector<luna::Vertex> vertices; // cpu side copy of the vertex buffer
 				luna::Mesh mesh;
 				size_t maskIdx = size_t(-1);
 			};
@@ -24,6 +62,38 @@ namespace luna {
 			void endFrame() override;
 			void render(const luna::Camera& camera) override;
 
+			/**
+			 * @brief The amount of vertex data that was repacked on the cpu and uploaded during the last endFrame
+			*/
+			const RendererStats& getStats() const;
+
+			/**
+			 * @brief Spreads the vertex repacking in endFrame over the workers of a pool. Every batch is repacked into
+			 * its own staging memory, the uploads still happen on the thread that calls endFrame. The work is handed out
+			 * through ThreadPool::parallelFor, so a frame without a draw order change allocates nothing on this path either.
+			 * @param pool The pool to use, or nullptr to repack everything on the calling thread (the default)
+			*/
+			void setThreadPool(ThreadPool* pool);
+			ThreadPool* getThreadPool() const;
+
+			void setMaskMode(MaskMode mode);
+			MaskMode getMaskMode() const;
+
+			/**
+			 * @brief Sets the resolution of the mask texture used by MaskMode::PerBatch, relative to the camera target.
+			 * The masks get stretched over the whole mask texture, so small masks keep their detail at lower scales.
+			 * @param scale The scale of the mask texture, 1 by default
+			*/
+			void setMaskResolutionScale(float scale);
+			float getMaskResolutionScale() const;
+
+			/**
+			 * @brief Sets the resolution of the mask atlas used by MaskMode::Atlas
+			 * @param size The width and height of the atlas in pixels, 2048 by default
+			*/
+			void setMaskAtlasSize(unsigned int size);
+			unsigned int getMaskAtlasSize() const;
+
 		protected:
 			/**
 			 * @brief Checks if a drawable fits within a batch (and can thus be rendered within a single drawcall). 
@@ -42,26 +112,93 @@ namespace luna {
 			std::vector<Batch> batches;
 			
 			/**
-			 * @brief Batches for rendering masks
+			 * @brief Batches for rendering masks, every distinct set of masks has one entry that is shared by all
+			 * batches using it
 			*/
 			std::vector<std::vector<Batch>> maskBatches;
 
 		private:
-			bool checkRebuild();
+			/**
+			 * @brief Where the masks of a mask set end up in the mask texture, passed to the shaders as
+			 * Live2DMaskTarget, Live2DMaskRegion and Live2DMaskBounds
+			*/
+			struct MaskMapping {
+				glm::vec4 target = glm::vec4(1.0f, 1.0f, 0.0f, 0.0f); // clip space to mask texture clip space (scale, offset)
+				glm::vec4 region = glm::vec4(1.0f, 1.0f, 0.0f, 0.0f); // screen uv to mask texture uv (scale, offset)
+				glm::vec4 bounds = glm::vec4(0.0f, 0.0f, 1.0f, 1.0f); // the uv range sampling gets clamped to (min, max)
+			};
+
+			struct BatchUpdate {
+				Batch* batch;
+				bool isMask;
+				size_t repackedVertices = 0;
+				size_t repackedBytes = 0;
+			};
+
+			enum class Rebuild { None, Order, Full };
+
+			Rebuild checkRebuild(csmFlags changed);
+			csmFlags summarizeFlags();
+			void buildUpdateList();
+			size_t getCoreIndex(const Drawable* drawable) const;
 
 			void sortDrawables();
+			void resortDrawables();
+			void compactMaskSets();
 			void buildBatches();
+			size_t getMaskSet(const Drawable& drawable, size_t& maskCount);
+			size_t findMaskSet(const Drawable& drawable, size_t maskSetCount);
+			static Batch& nextBatch(std::vector<Batch>& list, size_t& count);
+
+			void buildMeshIndices(Batch& batch);
+			void buildMeshVertices(Batch& batch, bool isMask);
+			static void updateMeshVertices(BatchUpdate& update);
+			static void writeDrawableVertices(Batch& batch, size_t drawableIdx, bool isMask);
+			static void writeDrawablePositions(Batch& batch, size_t drawableIdx);
+			void uploadMeshVertices(Batch& batch);
 
-			static void buildMeshIndices(Batch& batch);
-			static void buildMeshVertices(Batch& batch, bool isMask);
+			void renderMaskAtlas(const luna::Camera& camera, const glm::mat4& modelMatrix, const glm::mat4& mvp);
+			bool checkMaskShaders();
+			bool computeMaskMapping(size_t maskIdx, const glm::mat4& mvp, glm::vec2 cellMin, glm::vec2 cellMax, glm::vec2 textureSize, MaskMapping& mapping) const;
 
-			void drawBatch(const Batch& batch, const glm::mat4& matrix, const luna::Texture* mask = nullptr, bool inverseMask = false);
+			void drawBatch(const Batch& batch, const glm::mat4& matrix, const luna::Texture* mask = nullptr, bool inverseMask = false, const MaskMapping* maskMapping = nullptr);
 
 		private:
 			const ModelInstance* m_model;
 
 			luna::Texture m_noMaskTexture;
 			std::vector<const Drawable*> m_drawables;
+			std::vector<unsigned int> m_indices; // scratch storage for buildMeshIndices
+
+			// the canonical mask set of every entry in maskBatches
+			std::vector<std::vector<int>> m_maskSets;
+			std::vector<size_t> m_maskSetHashes;
+			std::vector<int> m_maskKey;
+
+			// scratch storage for resortDrawables
+			std::vector<const Drawable*> m_previousDrawables;
+			std::vector<Batch> m_resortBatches;
+			std::vector<size_t> m_maskRemap;
+
+			RendererStats m_stats;
+
+			ThreadPool* m_threadPool = nullptr;
+
+			// every batch and mask batch, and which of them changed this frame
+			std::vector<BatchUpdate> m_batchUpdates;
+			std::vector<uint64_t> m_dirtyBatches;
+			std::vector<uint32_t> m_dirtyUpdates;
+
+			// the entries of m_batchUpdates that contain a drawable, indexed by the csmModel drawable index
+			std::vector<uint32_t> m_flagTargetOffsets;
+			std::vector<uint32_t> m_flagTargets;
+			std::vector<uint32_t> m_flagTargetCursors;
+
+			MaskMode m_maskMode = MaskMode::PerBatch;
+			float m_maskResolutionScale = 1.0f;
+			unsigned int m_maskAtlasSize = 2048;
+			std::vector<MaskMapping> m_maskMappings;
+			std::vector<uint8_t> m_maskFitted; // whether the shaders of a mask set declare the uniforms of the fitted mapping
 		};
 
 	}
@@ -0,0 +1,125 @@
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#define LUNA_LIVE2D_SIMD_AVX
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define LUNA_LIVE2D_SIMD_SSE
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#include <arm_neon.h>
+#define LUNA_LIVE2D_SIMD_NEON
+#endif
+
+namespace luna {
+	namespace live2d {
+
+		/**
+		 * @brief A minimal wrapper around the SIMD instruction set of the target (AVX, SSE2 or NEON, with a scalar
+		 * fallback), only covering what the physics kernels need. Loads and stores are unaligned.
+		*/
+		namespace simd {
+
+#if defined(LUNA_LIVE2D_SIMD_AVX)
+			constexpr size_t Width = 8;
+
+			struct Float { __m256 v; };
+			struct Mask { __m256 v; };
+
+			inline Float load(const float* p) { return { _mm256_loadu_ps(p) }; }
+			inline void store(float* p, Float a) { _mm256_storeu_ps(p, a.v); }
+			inline Float set(float x) { return { _mm256_set1_ps(x) }; }
+
+			inline Float operator+(Float a, Float b) { return { _mm256_add_ps(a.v, b.v) }; }
+			inline Float operator-(Float a, Float b) { return { _mm256_sub_ps(a.v, b.v) }; }
+			inline Float operator*(Float a, Float b) { return { _mm256_mul_ps(a.v, b.v) }; }
+			inline Float operator/(Float a, Float b) { return { _mm256_div_ps(a.v, b.v) }; }
+			inline Float sqrt(Float a) { return { _mm256_sqrt_ps(a.v) }; }
+			inline Float abs(Float a) { return { _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a.v) }; }
+
+			inline Mask operator<(Float a, Float b) { return { _mm256_cmp_ps(a.v, b.v, _CMP_LT_OQ) }; }
+			inline Mask operator!=(Float a, Float b) { return { _mm256_cmp_ps(a.v, b.v, _CMP_NEQ_UQ) }; }
+			inline Mask operator&(Mask a, Mask b) { return { _mm256_and_ps(a.v, b.v) }; }
+			inline Float select(Mask m, Float a, Float b) { return { _mm256_blendv_ps(b.v, a.v, m.v) }; }
+
+#elif defined(LUNA_LIVE2D_SIMD_SSE)
+			constexpr size_t Width = 4;
+
+			struct Float { __m128 v; };
+			struct Mask { __m128 v; };
+
+			inline Float load(const float* p) { return { _mm_loadu_ps(p) }; }
+			inline void store(float* p, Float a) { _mm_storeu_ps(p, a.v); }
+			inline Float set(float x) { return { _mm_set1_ps(x) }; }
+
+			inline Float operator+(Float a, Float b) { return { _mm_add_ps(a.v, b.v) }; }
+			inline Float operator-(Float a, Float b) { return { _mm_sub_ps(a.v, b.v) }; }
+			inline Float operator*(Float a, Float b) { return { _mm_mul_ps(a.v, b.v) }; }
+			inline Float operator/(Float a, Float b) { return { _mm_div_ps(a.v, b.v) }; }
+			inline Float sqrt(Float a) { return { _mm_sqrt_ps(a.v) }; }
+			inline Float abs(Float a) { return { _mm_andnot_ps(_mm_set1_ps(-0.0f), a.v) }; }
+
+			inline Mask operator<(Float a, Float b) { return { _mm_cmplt_ps(a.v, b.v) }; }
+			inline Mask operator!=(Float a, Float b) { return { _mm_cmpneq_ps(a.v, b.v) }; }
+			inline Mask operator&(Mask a, Mask b) { return { _mm_and_ps(a.v, b.v) }; }
+			inline Float select(Mask m, Float a, Float b) { return { _mm_or_ps(_mm_and_ps(m.v, a.v), _mm_andnot_ps(m.v, b.v)) }; }
+
+#elif defined(LUNA_LIVE2D_SIMD_NEON)
+			constexpr size_t Width = 4;
+
+			struct Float { float32x4_t v; };
+			struct Mask { uint32x4_t v; };
+
+			inline Float load(const float* p) { return { vld1q_f32(p) }; }
+			inline void store(float* p, Float a) { vst1q_f32(p, a.v); }
+			inline Float set(float x) { return { vdupq_n_f32(x) }; }
+
+			inline Float operator+(Float a, Float b) { return { vaddq_f32(a.v, b.v) }; }
+			inline Float operator-(Float a, Float b) { return { vsubq_f32(a.v, b.v) }; }
+			inline Float operator*(Float a, Float b) { return { vmulq_f32(a.v, b.v) }; }
+			inline Float operator/(Float a, Float b) { return { vdivq_f32(a.v, b.v) }; }
+			inline Float sqrt(Float a) { return { vsqrtq_f32(a.v) }; }
+			inline Float abs(Float a) { return { vabsq_f32(a.v) }; }
+
+			inline Mask operator<(Float a, Float b) { return { vcltq_f32(a.v, b.v) }; }
+			inline Mask operator!=(Float a, Float b) { return { vmvnq_u32(vceqq_f32(a.v, b.v)) }; }
+			inline Mask operator&(Mask a, Mask b) { return { vandq_u32(a.v, b.v) }; }
+			inline Float select(Mask m, Float a, Float b) { return { vbslq_f32(m.v, a.v, b.v) }; }
+
+#else
+			constexpr size_t Width = 4;
+
+			struct Float { float v[Width]; };
+			struct Mask { bool v[Width]; };
+
+			inline Float load(const float* p) { Float r; for (size_t i = 0; i < Width; ++i) r.v[i] = p[i]; return r; }
+			inline void store(float* p, Float a) { for (size_t i = 0; i < Width; ++i) p[i] = a.v[i]; }
+			inline Float set(float x) { Float r; for (size_t i = 0; i < Width; ++i) r.v[i] = x; return r; }
+
+			inline Float operator+(Float a, Float b) { for (size_t i = 0; i < Width; ++i) a.v[i] += b.v[i]; return a; }
+			inline Float operator-(Float a, Float b) { for (size_t i = 0; i < Width; ++i) a.v[i] -= b.v[i]; return a; }
+			inline Float operator*(Float a, Float b) { for (size_t i = 0; i < Width; ++i) a.v[i] *= b.v[i]; return a; }
+			inline Float operator/(Float a, Float b) { for (size_t i = 0; i < Width; ++i) a.v[i] /= b.v[i]; return a; }
+			inline Float sqrt(Float a) { for (size_t i = 0; i < Width; ++i) a.v[i] = std::sqrt(a.v[i]); return a; }
+			inline Float abs(Float a) { for (size_t i = 0; i < Width; ++i) a.v[i] = std::abs(a.v[i]); return a; }
+
+			inline Mask operator<(Float a, Float b) { Mask r; for (size_t i = 0; i < Width; ++i) r.v[i] = a.v[i] < b.v[i]; return r; }
+			inline Mask operator!=(Float a, Float b) { Mask r; for (size_t i = 0; i < Width; ++i) r.v[i] = a.v[i] != b.v[i]; return r; }
+			inline Mask operator&(Mask a, Mask b) { for (size_t i = 0; i < Width; ++i) a.v[i] = a.v[i] && b.v[i]; return a; }
+			inline Float select(Mask m, Float a, Float b) { for (size_t i = 0; i < Width; ++i) a.v[i] = m.v[i] ? a.v[i] : b.v[i]; return a; }
+#endif
+
+			/**
+			 * @return count rounded up to a multiple of the SIMD width
+			*/
+			constexpr size_t padToWidth(size_t count) {
+				return (count + Width - 1) / Width * Width;
+			}
+
+		}
+
+	}
+}
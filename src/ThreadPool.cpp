@@ -0,0 +1,115 @@
+#include "ThreadPool.hpp"
+
+#include <algorithm>
+
+namespace luna {
+	namespace live2d {
+
+		ThreadPool::ThreadPool(size_t threadCount) {
+			if (threadCount == 0)
+				threadCount = std::max(size_t(std::thread::hardware_concurrency()), size_t(2)) - 1;
+
+			m_threads.reserve(threadCount);
+			for (size_t i = 0; i < threadCount; ++i)
+				m_threads.emplace_back([this]() { workerLoop(); });
+		}
+
+		ThreadPool::~ThreadPool() {
+			{
+				std::lock_guard lock(m_mutex);
+				m_stopping = true;
+			}
+			m_condition.notify_all();
+
+			for (auto& thread : m_threads)
+				thread.join();
+		}
+
+		size_t ThreadPool::getThreadCount() const {
+			return m_threads.size();
+		}
+
+		ThreadPool& ThreadPool::getShared() {
+			static ThreadPool pool;
+			return pool;
+		}
+
+		void ThreadPool::parallelFor(size_t count, ForBody body, void* context) {
+			if (m_threads.empty() || count < 2 || m_forRunning.exchange(true)) {
+				for (size_t i = 0; i < count; ++i)
+					body(context, i);
+				return;
+			}
+
+			{
+				std::lock_guard lock(m_mutex);
+				m_forBody = body;
+				m_forContext = context;
+				m_forCount = count;
+				m_forNext = 0;
+				++m_forGeneration;
+			}
+			m_condition.notify_all();
+
+			// this thread takes a share as well
+			for (size_t i = m_forNext++; i < count; i = m_forNext++)
+				body(context, i);
+
+			// every index is handed out, wait for the workers that are still running one
+			std::unique_lock lock(m_mutex);
+			m_forDone.wait(lock, [this]() { return m_forWorkers == 0; });
+			m_forBody = nullptr;
+			m_forRunning = false;
+		}
+
+		void ThreadPool::runFor() {
+			for (size_t i = m_forNext++; i < m_forCount; i = m_forNext++)
+				m_forBody(m_forContext, i);
+		}
+
+		void ThreadPool::enqueue(std::function<void()> job) {
+			{
+				std::lock_guard lock(m_mutex);
+				m_jobs.push(std::move(job));
+			}
+			m_condition.notify_one();
+		}
+
+		void ThreadPool::workerLoop() {
+			uint64_t forGeneration = 0;
+
+			while (true) {
+				std::function<void()> job;
+
+				{
+					std::unique_lock lock(m_mutex);
+					m_condition.wait(lock, [&]() { return m_stopping || !m_jobs.empty() || (m_forBody && m_forGeneration != forGeneration); });
+
+					// join a parallelFor before picking up queued jobs, the thread that started it is waiting
+					if (m_forBody && m_forGeneration != forGeneration) {
+						forGeneration = m_forGeneration;
+						++m_forWorkers;
+						lock.unlock();
+
+						runFor();
+
+						lock.lock();
+						if (--m_forWorkers == 0)
+							m_forDone.notify_all();
+						continue;
+					}
+
+					// keep going until the queue is empty, so no submitted future is left without a value
+					if (m_jobs.empty())
+						return;
+
+					job = std::move(m_jobs.front());
+					m_jobs.pop();
+				}
+
+				job();
+			}
+		}
+
+	}
+}
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace luna {
+	namespace live2d {
+
+		/**
+		 * @brief A small fixed-size pool of worker threads, used for work that can be spread over multiple
+		 * cores like loading models. Jobs are executed in the order they are submitted.
+		*/
+		class ThreadPool {
+		public:
+			/**
+			 * @param threadCount The amount of worker threads, 0 picks one thread less than the amount of cores
+			*/
+			explicit ThreadPool(size_t threadCount = 0);
+			ThreadPool(ThreadPool&) = delete;
+			ThreadPool& operator=(ThreadPool&) = delete;
+
+			/**
+			 * @brief Finishes all the jobs that are still queued and stops the worker threads
+			*/
+			~ThreadPool();
+
+			/**
+			 * @brief Queues a job to be executed on one of the worker threads
+			 * @param job The job, a callable without arguments
+			 * @return A future that holds the result (or the exception) of the job
+			*/
+			template<typename F>
+			auto submit(F&& job) -> std::future<std::invoke_result_t<std::decay_t<F>>> {
+				using Result = std::invoke_result_t<std::decay_t<F>>;
+				auto task = std::make_shared<std::packaged_task<Result()>>(std::forward<F>(job));
+				auto future = task->get_future();
+				enqueue([task]() { (*task)(); });
+				return future;
+			}
+
+			/**
+			 * @brief Runs body(i) for every i in [0, count) on the worker threads and the calling thread, and returns once
+			 * all of them are done. Unlike submit() this allocates nothing: the body is called through a pointer to it and
+			 * the indices are handed out by an atomic counter. Only one parallelFor runs on a pool at a time, when the pool is
+			 * busy with another one (or this is called from inside a body) the calling thread runs every index itself.
+			 * @param count The amount of indices
+			 * @param body A callable that takes a size_t
+			*/
+			template<typename F>
+			void parallelFor(size_t count, F&& body) {
+				using Body = std::remove_reference_t<F>;
+				parallelFor(count, [](void* context, size_t i) { (*static_cast<Body*>(context))(i); }, const_cast<void*>(static_cast<const void*>(&body)));
+			}
+
+			size_t getThreadCount() const;
+
+			/**
+			 * @return A pool that is shared by the whole library, it gets created the first time it is used
+			*/
+			static ThreadPool& getShared();
+
+		private:
+			using ForBody = void (*)(void* context, size_t i);
+
+			void parallelFor(size_t count, ForBody body, void* context);
+			void runFor();
+			void enqueue(std::function<void()> job);
+			void workerLoop();
+
+		private:
+			std::vector<std::thread> m_threads;
+			std::queue<std::function<void()>> m_jobs;
+			std::mutex m_mutex;
+			std::condition_variable m_condition;
+			bool m_stopping = false;
+
+			// the running parallelFor, workers join it when its generation changes
+			std::atomic<bool> m_forRunning = false;
+			std::condition_variable m_forDone;
+			ForBody m_forBody = nullptr;
+			void* m_forContext = nullptr;
+			size_t m_forCount = 0;
+			std::atomic<size_t> m_forNext = 0;
+			size_t m_forWorkers = 0;
+			uint64_t m_forGeneration = 0;
+		};
+
+	}
+}
@@ -0,0 +1,74 @@
+#include "VertexKernels.hpp"
+
+#include "Simd.hpp"
+
+namespace luna {
+	namespace live2d {
+		namespace vertices {
+
+			namespace {
+				// two packed glm::vec2 are loaded as one register and stored into the x and y of two vertices
+#if defined(LUNA_LIVE2D_SIMD_AVX) || defined(LUNA_LIVE2D_SIMD_SSE)
+				inline void copyPair(float* a, float* b, const glm::vec2* src) {
+					__m128 v = _mm_loadu_ps(&src->x);
+					_mm_storel_pi(reinterpret_cast<__m64*>(a), v);
+					_mm_storeh_pi(reinterpret_cast<__m64*>(b), v);
+				}
+#elif defined(LUNA_LIVE2D_SIMD_NEON)
+				inline void copyPair(float* a, float* b, const glm::vec2* src) {
+					float32x4_t v = vld1q_f32(&src->x);
+					vst1_f32(a, vget_low_f32(v));
+					vst1_f32(b, vget_high_f32(v));
+				}
+#else
+				inline void copyPair(float* a, float* b, const glm::vec2* src) {
+					a[0] = src[0].x;
+					a[1] = src[0].y;
+					b[0] = src[1].x;
+					b[1] = src[1].y;
+				}
+#endif
+			}
+
+			void write(luna::Vertex* out, const glm::vec2* positions, const glm::vec2* uvs, size_t count, glm::vec3 screenColor, uint32_t multiplyColor) {
+				// everything that is the same for the whole drawable is copied in from a prototype
+				const luna::Vertex prototype(glm::vec3(0.0f), glm::vec2(0.0f), screenColor, multiplyColor);
+
+				size_t i = 0;
+				for (; i + 2 <= count; i += 2) {
+					out[i] = prototype;
+					out[i + 1] = prototype;
+					copyPair(&out[i].position.x, &out[i + 1].position.x, positions + i);
+					copyPair(&out[i].uv.x, &out[i + 1].uv.x, uvs + i);
+				}
+
+				if (i < count)
+					out[i] = luna::Vertex(glm::vec3(positions[i], 0.0f), uvs[i], screenColor, multiplyColor);
+			}
+
+			void writeScalar(luna::Vertex* out, const glm::vec2* positions, const glm::vec2* uvs, size_t count, glm::vec3 screenColor, uint32_t multiplyColor) {
+				for (size_t i = 0; i < count; ++i)
+					out[i] = luna::Vertex(glm::vec3(positions[i], 0.0f), uvs[i], screenColor, multiplyColor);
+			}
+
+			void writePositions(luna::Vertex* out, const glm::vec2* positions, size_t count) {
+				size_t i = 0;
+				for (; i + 2 <= count; i += 2)
+					copyPair(&out[i].position.x, &out[i + 1].position.x, positions + i);
+
+				if (i < count) {
+					out[i].position.x = positions[i].x;
+					out[i].position.y = positions[i].y;
+				}
+			}
+
+			void writePositionsScalar(luna::Vertex* out, const glm::vec2* positions, size_t count) {
+				for (size_t i = 0; i < count; ++i) {
+					out[i].position.x = positions[i].x;
+					out[i].position.y = positions[i].y;
+				}
+			}
+
+		}
+	}
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <luna.hpp>
+
+namespace luna {
+	namespace live2d {
+
+		/**
+		 * @brief Kernels that convert the vertex arrays of a Drawable into luna::Vertex data. The default versions
+		 * move two vertices per instruction (SSE2 or NEON, with a scalar fallback), the Scalar versions convert
+		 * one vertex at a time and produce exactly the same output.
+		*/
+		namespace vertices {
+
+			/**
+			 * @brief Writes a full vertex for every position and uv of a drawable
+			 * @param out The vertices to write to, at least count of them
+			 * @param positions The vertex positions of the drawable
+			 * @param uvs The vertex uvs of the drawable
+			 * @param count The amount of vertices
+			 * @param screenColor The screen colour of the drawable, passed as the normal
+			 * @param multiplyColor The compressed multiply colour of the drawable
+			*/
+			void write(luna::Vertex* out, const glm::vec2* positions, const glm::vec2* uvs, size_t count, glm::vec3 screenColor, uint32_t multiplyColor);
+			void writeScalar(luna::Vertex* out, const glm::vec2* positions, const glm::vec2* uvs, size_t count, glm::vec3 screenColor, uint32_t multiplyColor);
+
+			/**
+			 * @brief Only overwrites the x and y of the vertex positions, everything else is left untouched
+			 * @param out The vertices to write to, at least count of them
+			 * @param positions The vertex positions of the drawable
+			 * @param count The amount of vertices
+			*/
+			void writePositions(luna::Vertex* out, const glm::vec2* positions, size_t count);
+			void writePositionsScalar(luna::Vertex* out, const glm::vec2* positions, size_t count);
+
+		}
+	}
+}
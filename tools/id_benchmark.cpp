@@ -0,0 +1,87 @@
+#include <LunaLive2D.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Looks up every parameter and drawable id of a model through the IdIndex, and through the linear find_if the
+// ModelInstance used before it, and reports how long a lookup took.
+// usage: lunalive2d_id_benchmark [file.model3.json] [rounds]
+
+namespace {
+	using Clock = std::chrono::steady_clock;
+
+	template<typename Lookup>
+	double time(const std::vector<const char*>& ids, int rounds, Lookup lookup) {
+		size_t found = 0;
+		auto start = Clock::now();
+		for (int r = 0; r < rounds; ++r) {
+			for (const char* id : ids)
+				found += lookup(id);
+		}
+		double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+		if (found != ids.size() * size_t(rounds))
+			std::cout << "  missed " << ids.size() * size_t(rounds) - found << " lookups" << std::endl;
+		return seconds * 1e9 / double(ids.size() * size_t(rounds));
+	}
+
+	template<typename T>
+	void benchmark(const char* name, const T* items, size_t count, const luna::live2d::IdIndex& index, int rounds) {
+		std::vector<const char*> ids;
+		for (size_t i = 0; i < count; ++i)
+			ids.push_back(items[i].getId());
+
+		// what ModelInstance::getParameter and getDrawable did before the index: hash the id, then compare hashes
+		double hashScan = time(ids, rounds, [&](const char* id) {
+			std::hash<std::string> hasher;
+			size_t hash = hasher(id);
+			return std::find_if(items, items + count, [hash](const T& x) { return x.getIdHash() == hash; }) != items + count;
+		});
+
+		double stringScan = time(ids, rounds, [&](const char* id) {
+			return std::find_if(items, items + count, [id](const T& x) { return strcmp(x.getId(), id) == 0; }) != items + count;
+		});
+
+		double indexed = time(ids, rounds, [&](const char* id) {
+			return index.find(id) != luna::live2d::IdIndex::npos;
+		});
+
+		std::cout << name << ": " << count << " ids" << std::endl;
+		std::cout << "  hash + find_if:   " << hashScan << " ns/lookup" << std::endl;
+		std::cout << "  strcmp + find_if: " << stringScan << " ns/lookup" << std::endl;
+		std::cout << "  IdIndex:          " << indexed << " ns/lookup (" << hashScan / indexed << "x)" << std::endl;
+	}
+}
+
+int main(int argc, char** argv) {
+	luna::setMessageCallback([](const char* message, const char* prefix, luna::MessageSeverity severity) {
+		std::cout << "<" << prefix << "> " << message << std::endl;
+	});
+
+	const char* modelPath = argc > 1 ? argv[1] : "example/assets/models/niziiro/mao_pro.model3.json";
+	int rounds = argc > 2 ? std::stoi(argv[2]) : 10000;
+
+	// the model loads its textures, so it needs a graphics context
+	luna::initialize();
+	luna::live2d::initialize();
+	luna::Window window("Id Benchmark", 64, 64);
+
+	{
+		luna::live2d::Model model(modelPath);
+		luna::live2d::ModelInstance instance(&model);
+		if (!model.isValid()) {
+			std::cout << "failed to load " << modelPath << std::endl;
+			return 1;
+		}
+
+		benchmark("parameters", instance.getParameters(), instance.getParameterCount(), model.getParameterIndex(), rounds);
+		benchmark("drawables", instance.getDrawables(), instance.getDrawableCount(), model.getDrawableIndex(), rounds);
+	}
+
+	luna::live2d::terminate();
+	luna::terminate();
+}
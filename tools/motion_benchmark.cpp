@@ -0,0 +1,171 @@
+#include <LunaLive2D.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Plays every motion of a model, once by searching for the segment of every curve each frame and once with the cursors
+// of a MotionPlayer, and reports how long a frame took and whether both ways agree. Then plays every motion on a crowd,
+// once with a cursor per instance and once with a single Motion::sample per frame. Finally bakes every motion at its Fps
+// and reports the size and error of the tables, and how long a frame takes with them.
+// usage: lunalive2d_motion_benchmark [file.model3.json...]
+
+namespace {
+	using Clock = std::chrono::steady_clock;
+	constexpr float deltatime = 1.0f / 60.0f;
+	constexpr size_t crowdSize = 256;
+
+	// every instance of the crowd is a bit further into the motion, so the times stay sorted apart from where they wrap
+	void crowd(const luna::live2d::Motion& motion, int frames) {
+		size_t curveCount = motion.getCurveCount();
+		std::vector<float> times(crowdSize);
+		std::vector<uint32_t> cursors(crowdSize * curveCount);
+		std::vector<float> cursorValues(crowdSize * curveCount);
+		std::vector<float> sampleValues(crowdSize * curveCount);
+
+		auto setTimes = [&](int frame) {
+			for (size_t i = 0; i < crowdSize; ++i)
+				times[i] = fmodf(float(frame) * deltatime + float(i) * motion.getDuration() / float(crowdSize), motion.getDuration());
+		};
+
+		auto start = Clock::now();
+		for (int f = 0; f < frames; ++f) {
+			setTimes(f);
+			for (size_t i = 0; i < crowdSize; ++i) {
+				for (size_t c = 0; c < curveCount; ++c)
+					cursorValues[c * crowdSize + i] = motion.evaluate(c, times[i], cursors[i * curveCount + c]);
+			}
+		}
+		double cursorSeconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+		start = Clock::now();
+		for (int f = 0; f < frames; ++f) {
+			setTimes(f);
+			motion.sample(times.data(), crowdSize, sampleValues.data());
+		}
+		double sampleSeconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+		float maxError = 0.0f;
+		for (size_t i = 0; i < sampleValues.size(); ++i)
+			maxError = std::max(maxError, std::abs(sampleValues[i] - cursorValues[i]));
+
+		std::cout << "  crowd of " << crowdSize << ", cursors: " << cursorSeconds * 1e6 / frames << " us/frame" << std::endl;
+		std::cout << "  crowd of " << crowdSize << ", sample:  " << sampleSeconds * 1e6 / frames << " us/frame (" << cursorSeconds / sampleSeconds << "x)"
+			<< ", max difference: " << maxError << std::endl;
+	}
+
+	void benchmark(const luna::live2d::Motion& motion, luna::live2d::ModelInstance& instance, const std::string& name, int loops) {
+		int frames = std::max(int(motion.getDuration() / deltatime), 1) * loops;
+
+		// search for the segments from scratch every frame
+		volatile float sink = 0.0f;
+		auto start = Clock::now();
+		for (int f = 0; f < frames; ++f) {
+			float time = fmodf(float(f) * deltatime, motion.getDuration());
+			for (size_t c = 0; c < motion.getCurveCount(); ++c)
+				sink = sink + motion.evaluate(c, time);
+		}
+		double searchSeconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+		// the same frames through the cursors, without writing to the model
+		std::vector<uint32_t> cursors(motion.getCurveCount());
+		float maxError = 0.0f;
+		start = Clock::now();
+		for (int f = 0; f < frames; ++f) {
+			float time = fmodf(float(f) * deltatime, motion.getDuration());
+			for (size_t c = 0; c < motion.getCurveCount(); ++c)
+				sink = sink + motion.evaluate(c, time, cursors[c]);
+		}
+		double cursorSeconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+		for (int f = 0; f < frames; ++f) {
+			float time = fmodf(float(f) * deltatime, motion.getDuration());
+			for (size_t c = 0; c < motion.getCurveCount(); ++c)
+				maxError = std::max(maxError, std::abs(motion.evaluate(c, time) - motion.evaluate(c, time, cursors[c])));
+		}
+
+		// and through a MotionPlayer, which also writes the parameters and part opacities
+		luna::live2d::MotionPlayer player(&motion);
+		player.attachTo(&instance);
+		player.setLooping(true);
+		start = Clock::now();
+		for (int f = 0; f < frames; ++f)
+			player.update(deltatime);
+		double playerSeconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+		// and through a MotionStack, with the motion on an override and an additive layer
+		luna::live2d::MotionStack stack;
+		stack.attachTo(&instance);
+		stack.addLayer(luna::live2d::MotionBlendMode::Additive, 0.5f);
+		stack.setIdleMotion(0, &motion);
+		stack.setIdleMotion(1, &motion);
+		start = Clock::now();
+		for (int f = 0; f < frames; ++f)
+			stack.update(deltatime);
+		double stackSeconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+		std::cout << name << ": " << motion.getCurveCount() << " curves, " << motion.getSegmentCount() << " segments, "
+			<< (motion.areBeziersRestricted() ? "restricted" : "unrestricted") << " beziers" << std::endl;
+		std::cout << "  search: " << searchSeconds * 1e6 / frames << " us/frame" << std::endl;
+		std::cout << "  cursor: " << cursorSeconds * 1e6 / frames << " us/frame (" << searchSeconds / cursorSeconds << "x)" << std::endl;
+		std::cout << "  player: " << playerSeconds * 1e6 / frames << " us/frame" << std::endl;
+		std::cout << "  stack:  " << stackSeconds * 1e6 / frames << " us/frame (2 layers)" << std::endl;
+		std::cout << "  max difference: " << maxError << std::endl;
+
+		crowd(motion, frames / loops);
+
+		// a baked copy, through the same cursors as above
+		luna::live2d::Motion baked = motion;
+		luna::live2d::MotionBakeStats stats = baked.bake();
+		start = Clock::now();
+		for (int f = 0; f < frames; ++f) {
+			float time = fmodf(float(f) * deltatime, baked.getDuration());
+			for (size_t c = 0; c < baked.getCurveCount(); ++c)
+				sink = sink + baked.evaluate(c, time, cursors[c]);
+		}
+		double bakedSeconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+		std::cout << "  baked:  " << bakedSeconds * 1e6 / frames << " us/frame (" << cursorSeconds / bakedSeconds << "x), "
+			<< stats.frameCount << " frames at " << stats.rate << " fps, " << stats.bakedBytes << " bytes (curves: " << stats.curveBytes
+			<< " bytes), max error: " << stats.maxError << ", " << stats.exactCurveCount << " stepped curves left exact" << std::endl;
+	}
+
+	void benchmark(const char* modelPath, int loops) {
+		luna::live2d::Model model(modelPath);
+		luna::live2d::ModelInstance instance(&model);
+		if (!model.isValid()) {
+			std::cout << "failed to load " << modelPath << std::endl;
+			return;
+		}
+
+		for (size_t g = 0; g < model.getMotionGroupCount(); ++g) {
+			const luna::live2d::MotionGroup& group = model.getMotionGroups()[g];
+			for (size_t m = 0; m < group.motions.size(); ++m)
+				benchmark(*group.motions[m].motion, instance, "\"" + group.name + "\" " + std::to_string(m), loops);
+		}
+	}
+}
+
+int main(int argc, char** argv) {
+	luna::setMessageCallback([](const char* message, const char* prefix, luna::MessageSeverity severity) {
+		std::cout << "<" << prefix << "> " << message << std::endl;
+	});
+
+	std::vector<const char*> modelPaths(argv + 1, argv + argc);
+	if (modelPaths.empty())
+		modelPaths = { "example/assets/models/hiyori/hiyori_free_t08.model3.json", "example/assets/models/niziiro/mao_pro.model3.json" };
+	constexpr int loops = 20;
+
+	// the model loads its textures, so it needs a graphics context
+	luna::initialize();
+	luna::live2d::initialize();
+	luna::Window window("Motion Benchmark", 64, 64);
+
+	for (const char* modelPath : modelPaths)
+		benchmark(modelPath, loops);
+
+	luna::live2d::terminate();
+	luna::terminate();
+}
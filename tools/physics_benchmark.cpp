@@ -0,0 +1,102 @@
+#include <LunaLive2D.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <string>
+
+// Runs the physics of a model with the scalar and the SIMD kernel side by side, and reports how long each kernel
+// took and how far the output parameters drifted apart.
+// usage: lunalive2d_physics_benchmark [file.model3.json] [steps]
+
+namespace {
+	using Clock = std::chrono::steady_clock;
+
+	// drives every input of the rig with a different sine wave, so all groups are moving
+	void animateInputs(luna::live2d::ModelInstance& instance, float time) {
+		const luna::live2d::PhysicsRig* rig = instance.getModel()->getPhysicsRig();
+		for (size_t g = 0; g < rig->getGroupCount(); ++g) {
+			for (auto& input : rig->getGroups()[g].getInputs()) {
+				luna::live2d::Parameter* parameter = instance.getParameter(input.parameter);
+				if (!parameter)
+					continue;
+
+				float t = 0.5f + 0.5f * sinf(time * (1.0f + 0.37f * float(input.parameter.index % 7)));
+				parameter->setValue(parameter->getMinValue() + t * (parameter->getMaxValue() - parameter->getMinValue()));
+			}
+		}
+	}
+
+	// returns how long the physics update took
+	double step(luna::live2d::ModelInstance& instance, float time, float deltatime) {
+		animateInputs(instance, time);
+
+		auto start = Clock::now();
+		instance.getPhysicsController()->update(deltatime);
+		return std::chrono::duration<double>(Clock::now() - start).count();
+	}
+
+	// largest difference between the physics outputs of two instances of the same model
+	float outputDifference(const luna::live2d::ModelInstance& a, const luna::live2d::ModelInstance& b) {
+		const luna::live2d::PhysicsRig* rig = a.getModel()->getPhysicsRig();
+		float difference = 0.0f;
+		for (size_t g = 0; g < rig->getGroupCount(); ++g) {
+			for (auto& output : rig->getGroups()[g].getOutputs()) {
+				const luna::live2d::Parameter* pa = a.getParameter(output.parameter);
+				const luna::live2d::Parameter* pb = b.getParameter(output.parameter);
+				if (pa && pb)
+					difference = std::max(difference, std::abs(pa->getValue() - pb->getValue()));
+			}
+		}
+		return difference;
+	}
+}
+
+int main(int argc, char** argv) {
+	luna::setMessageCallback([](const char* message, const char* prefix, luna::MessageSeverity severity) {
+		std::cout << "<" << prefix << "> " << message << std::endl;
+	});
+
+	const char* modelPath = argc > 1 ? argv[1] : "example/assets/models/niziiro/mao_pro.model3.json";
+	int steps = argc > 2 ? std::stoi(argv[2]) : 100000;
+	constexpr float deltatime = 1.0f / 60.0f;
+
+	// the model loads its textures, so it needs a graphics context
+	luna::initialize();
+	luna::live2d::initialize();
+	luna::Window window("Physics Benchmark", 64, 64);
+
+	{
+		luna::live2d::Model model(modelPath);
+		luna::live2d::ModelInstance scalar(&model);
+		luna::live2d::ModelInstance simd(&model);
+
+		if (!model.isValid() || !scalar.getPhysicsController()) {
+			std::cout << "failed: " << modelPath << " has no physics" << std::endl;
+			return 1;
+		}
+
+		scalar.getPhysicsController()->setKernel(luna::live2d::PhysicsKernel::Scalar);
+		simd.getPhysicsController()->setKernel(luna::live2d::PhysicsKernel::Simd);
+
+		// step both kernels side by side and compare after every step, both instances see exactly the same inputs
+		double scalarSeconds = 0.0, simdSeconds = 0.0;
+		float maxError = 0.0f;
+		for (int i = 0; i < steps; ++i) {
+			float time = float(i) * deltatime;
+			scalarSeconds += step(scalar, time, deltatime);
+			simdSeconds += step(simd, time, deltatime);
+			maxError = std::max(maxError, outputDifference(scalar, simd));
+		}
+
+		const luna::live2d::PhysicsRig* rig = model.getPhysicsRig();
+
+		std::cout << modelPath << ": " << rig->getGroupCount() << " groups, " << rig->getNodeCount() << " nodes, " << steps << " steps" << std::endl;
+		std::cout << "scalar: " << scalarSeconds * 1e6 / steps << " us/step" << std::endl;
+		std::cout << "simd:   " << simdSeconds * 1e6 / steps << " us/step (" << scalarSeconds / simdSeconds << "x)" << std::endl;
+		std::cout << "max output difference over all steps: " << maxError << std::endl;
+	}
+
+	luna::live2d::terminate();
+	luna::terminate();
+}
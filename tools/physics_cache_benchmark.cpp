@@ -0,0 +1,61 @@
+#include <LunaLive2D.hpp>
+#include <chrono>
+#include <iostream>
+#include <string>
+
+// Loads the physics of a model from its .physics3.json and from the binary cache, and reports how long a load took.
+// The cache is written next to the json first, like lunalive2d_physics_compiler does.
+// usage: lunalive2d_physics_cache_benchmark [file.physics3.json] [loads]
+
+namespace {
+	using Clock = std::chrono::steady_clock;
+
+	template<typename Load>
+	double time(int loads, Load load) {
+		size_t groups = 0;
+		auto start = Clock::now();
+		for (int i = 0; i < loads; ++i)
+			groups += load();
+		double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+		if (groups == 0)
+			std::cout << "  nothing was loaded" << std::endl;
+		return seconds * 1e6 / loads;
+	}
+}
+
+int main(int argc, char** argv) {
+	luna::setMessageCallback([](const char* message, const char* prefix, luna::MessageSeverity severity) {
+		std::cout << "<" << prefix << "> " << message << std::endl;
+	});
+
+	const char* sourcePath = argc > 1 ? argv[1] : "example/assets/models/niziiro/mao_pro.physics3.json";
+	int loads = argc > 2 ? std::stoi(argv[2]) : 1000;
+	std::string cachePath = luna::live2d::PhysicsCache::getCachePath(sourcePath);
+
+	luna::live2d::PhysicsRig rig(sourcePath);
+	if (rig.getGroupCount() == 0 || !luna::live2d::PhysicsCache::write(rig, sourcePath, cachePath.c_str())) {
+		std::cout << "failed: " << sourcePath << std::endl;
+		return 1;
+	}
+
+	double json = time(loads, [&]() {
+		return luna::live2d::PhysicsRig(sourcePath).getGroupCount();
+	});
+
+	// with the source path the cache checks the size and time of the json, without it no check at all
+	double cache = time(loads, [&]() {
+		auto cached = luna::live2d::PhysicsCache::read(cachePath.c_str(), sourcePath);
+		return cached ? cached->getGroupCount() : 0;
+	});
+
+	double unchecked = time(loads, [&]() {
+		auto cached = luna::live2d::PhysicsCache::read(cachePath.c_str(), nullptr);
+		return cached ? cached->getGroupCount() : 0;
+	});
+
+	std::cout << sourcePath << ": " << rig.getGroupCount() << " groups, " << rig.getNodeCount() << " nodes" << std::endl;
+	std::cout << "json:            " << json << " us/load" << std::endl;
+	std::cout << "cache:           " << cache << " us/load (" << json / cache << "x)" << std::endl;
+	std::cout << "cache, no check: " << unchecked << " us/load (" << json / unchecked << "x)" << std::endl;
+}
@@ -0,0 +1,34 @@
+#include <LunaLive2D.hpp>
+#include <iostream>
+#include <string>
+
+// Compiles .physics3.json files into the binary physics cache that Model::load prefers over the json.
+// usage: lunalive2d_physics_compiler <file.physics3.json> [more files...]
+
+int main(int argc, char** argv) {
+	luna::setMessageCallback([](const char* message, const char* prefix, luna::MessageSeverity severity) {
+		std::cout << "<" << prefix << "> " << message << std::endl;
+	});
+
+	if (argc < 2) {
+		std::cout << "usage: " << argv[0] << " <file.physics3.json> [more files...]" << std::endl;
+		return 1;
+	}
+
+	int result = 0;
+	for (int i = 1; i < argc; ++i) {
+		const char* sourcePath = argv[i];
+		std::string cachePath = luna::live2d::PhysicsCache::getCachePath(sourcePath);
+
+		luna::live2d::PhysicsRig rig(sourcePath);
+		if (rig.getGroupCount() == 0 || !luna::live2d::PhysicsCache::write(rig, sourcePath, cachePath.c_str())) {
+			std::cout << "failed: " << sourcePath << std::endl;
+			result = 1;
+			continue;
+		}
+
+		std::cout << sourcePath << " -> " << cachePath << std::endl;
+	}
+
+	return result;
+}
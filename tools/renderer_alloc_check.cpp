@@ -0,0 +1,158 @@
+#include <LunaLive2D.hpp>
+#include <ThreadPool.hpp>
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+#include <vector>
+
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+
+// Plays the first motion of a model and counts the heap allocations Renderer::endFrame makes, once on the calling
+// thread and once spread over a ThreadPool. Frames in which the draw order changed may allocate while the batches are
+// rebuilt, every other frame should allocate nothing. Exits with 1 when one of them did.
+// usage: lunalive2d_renderer_alloc_check [frames] [file.model3.json...]
+
+namespace {
+	std::atomic<size_t> allocationCount = 0;
+
+	void* allocate(size_t size) {
+		allocationCount.fetch_add(1, std::memory_order_relaxed);
+		if (void* ptr = std::malloc(size ? size : 1))
+			return ptr;
+		throw std::bad_alloc();
+	}
+
+	void* allocate(size_t size, std::align_val_t alignment) {
+		allocationCount.fetch_add(1, std::memory_order_relaxed);
+		size_t align = static_cast<size_t>(alignment);
+#ifdef _WIN32
+		void* ptr = _aligned_malloc(size ? size : 1, align);
+#else
+		void* ptr = std::aligned_alloc(align, (size + align - 1) / align * align);
+#endif
+		if (ptr)
+			return ptr;
+		throw std::bad_alloc();
+	}
+
+	// the msvc crt can't free aligned blocks with free
+	void deallocate(void* ptr, std::align_val_t) {
+#ifdef _WIN32
+		_aligned_free(ptr);
+#else
+		std::free(ptr);
+#endif
+	}
+}
+
+void* operator new(size_t size) { return allocate(size); }
+void* operator new[](size_t size) { return allocate(size); }
+void* operator new(size_t size, std::align_val_t alignment) { return allocate(size, alignment); }
+void* operator new[](size_t size, std::align_val_t alignment) { return allocate(size, alignment); }
+void operator delete(void* ptr) noexcept { std::free(ptr); }
+void operator delete[](void* ptr) noexcept { std::free(ptr); }
+void operator delete(void* ptr, size_t) noexcept { std::free(ptr); }
+void operator delete[](void* ptr, size_t) noexcept { std::free(ptr); }
+void operator delete(void* ptr, std::align_val_t alignment) noexcept { deallocate(ptr, alignment); }
+void operator delete[](void* ptr, std::align_val_t alignment) noexcept { deallocate(ptr, alignment); }
+void operator delete(void* ptr, size_t, std::align_val_t alignment) noexcept { deallocate(ptr, alignment); }
+void operator delete[](void* ptr, size_t, std::align_val_t alignment) noexcept { deallocate(ptr, alignment); }
+
+namespace {
+	constexpr float deltatime = 1.0f / 60.0f;
+
+	bool drawOrderChanged(const luna::live2d::ModelInstance& instance) {
+		const csmFlags* flags = instance.getDynamicFlags();
+		for (size_t i = 0; i < instance.getCoreDrawableCount(); ++i) {
+			// draw order or render order changed, the renderer resorts its batches
+			if (flags[i] & 0b11000)
+				return true;
+		}
+		return false;
+	}
+
+	// returns false when a frame without a draw order change allocated
+	bool check(luna::live2d::Model& model, luna::live2d::ThreadPool* pool, int frames) {
+		luna::live2d::ModelInstance instance(&model);
+		if (model.getMotionGroupCount() > 0)
+			instance.playMotion(model.getMotionGroups()[0].name.c_str());
+
+		luna::live2d::Renderer renderer(&instance);
+		renderer.setThreadPool(pool);
+
+		// let the batches and the pool settle before counting
+		for (int f = 0; f < 10; ++f) {
+			instance.update(deltatime);
+			renderer.beginFrame();
+			renderer.endFrame();
+		}
+
+		size_t steadyFrames = 0, steadyAllocations = 0, steadyFailures = 0;
+		size_t orderFrames = 0, orderAllocations = 0;
+		for (int f = 0; f < frames; ++f) {
+			instance.update(deltatime);
+			bool orderChanged = drawOrderChanged(instance);
+
+			size_t before = allocationCount.load();
+			renderer.beginFrame();
+			renderer.endFrame();
+			size_t allocations = allocationCount.load() - before;
+
+			if (orderChanged) {
+				++orderFrames;
+				orderAllocations += allocations;
+			} else {
+				++steadyFrames;
+				steadyAllocations += allocations;
+				steadyFailures += allocations != 0;
+			}
+		}
+
+		std::cout << (pool ? "  thread pool:   " : "  single thread: ") << steadyAllocations << " allocations in " << steadyFrames
+			<< " frames (" << steadyFailures << " frames allocated), " << orderAllocations << " allocations in " << orderFrames
+			<< " frames with a draw order change" << std::endl;
+		return steadyFailures == 0;
+	}
+}
+
+int main(int argc, char** argv) {
+	luna::setMessageCallback([](const char* message, const char* prefix, luna::MessageSeverity severity) {
+		std::cout << "<" << prefix << "> " << message << std::endl;
+	});
+
+	int frames = argc > 1 ? std::atoi(argv[1]) : 600;
+	std::vector<const char*> modelPaths(argv + std::min(argc, 2), argv + argc);
+	if (modelPaths.empty())
+		modelPaths = { "example/assets/models/hiyori/hiyori_free_t08.model3.json", "example/assets/models/niziiro/mao_pro.model3.json" };
+
+	// the renderer uploads its meshes, so it needs a graphics context
+	luna::initialize();
+	luna::live2d::initialize();
+	luna::Window window("Renderer Allocation Check", 64, 64);
+
+	bool passed = true;
+	{
+		luna::live2d::ThreadPool pool;
+		for (const char* modelPath : modelPaths) {
+			luna::live2d::Model model(modelPath);
+			if (!model.isValid()) {
+				std::cout << "failed to load " << modelPath << std::endl;
+				passed = false;
+				continue;
+			}
+
+			std::cout << modelPath << ":" << std::endl;
+			passed &= check(model, nullptr, frames);
+			passed &= check(model, &pool, frames);
+		}
+	}
+
+	luna::live2d::terminate();
+	luna::terminate();
+	std::cout << (passed ? "passed" : "FAILED") << std::endl;
+	return passed ? 0 : 1;
+}
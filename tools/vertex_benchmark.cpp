@@ -0,0 +1,93 @@
+#include <LunaLive2D.hpp>
+#include <VertexKernels.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Converts the vertex arrays of every drawable of a model into luna::Vertex data, with the per-vertex loop and with
+// the wide kernels, and reports how long each took.
+// usage: lunalive2d_vertex_benchmark [iterations] [file.model3.json...]
+
+namespace {
+	using Clock = std::chrono::steady_clock;
+
+	template<typename Func>
+	double time(int iterations, Func&& func) {
+		auto start = Clock::now();
+		for (int i = 0; i < iterations; ++i)
+			func();
+		return std::chrono::duration<double>(Clock::now() - start).count();
+	}
+
+	void benchmark(const char* modelPath, int iterations) {
+		luna::live2d::Model model(modelPath);
+		luna::live2d::ModelInstance instance(&model);
+		if (!model.isValid()) {
+			std::cout << "failed: " << modelPath << std::endl;
+			return;
+		}
+
+		size_t vertexCount = 0;
+		for (size_t i = 0; i < instance.getDrawableCount(); ++i)
+			vertexCount += instance.getDrawables()[i].getVertexCount();
+
+		std::vector<luna::Vertex> scalar(vertexCount);
+		std::vector<luna::Vertex> wide(vertexCount);
+
+		auto convert = [&](luna::Vertex* out, bool useScalar, bool positionsOnly) {
+			for (size_t i = 0; i < instance.getDrawableCount(); ++i) {
+				const luna::live2d::Drawable& drawable = instance.getDrawables()[i];
+				glm::vec3 screenCol = drawable.getScreenColor().vec3();
+				uint32_t multCol = drawable.getMultiplyColor().compressed();
+
+				if (positionsOnly && useScalar)
+					luna::live2d::vertices::writePositionsScalar(out, drawable.getVertexPositions(), drawable.getVertexCount());
+				else if (positionsOnly)
+					luna::live2d::vertices::writePositions(out, drawable.getVertexPositions(), drawable.getVertexCount());
+				else if (useScalar)
+					luna::live2d::vertices::writeScalar(out, drawable.getVertexPositions(), drawable.getVertexUvs(), drawable.getVertexCount(), screenCol, multCol);
+				else
+					luna::live2d::vertices::write(out, drawable.getVertexPositions(), drawable.getVertexUvs(), drawable.getVertexCount(), screenCol, multCol);
+
+				out += drawable.getVertexCount();
+			}
+		};
+
+		double fullScalar = time(iterations, [&]() { convert(scalar.data(), true, false); });
+		double fullWide = time(iterations, [&]() { convert(wide.data(), false, false); });
+		double positionsScalar = time(iterations, [&]() { convert(scalar.data(), true, true); });
+		double positionsWide = time(iterations, [&]() { convert(wide.data(), false, true); });
+
+		bool identical = std::memcmp(scalar.data(), wide.data(), vertexCount * sizeof(luna::Vertex)) == 0;
+
+		std::cout << modelPath << ": " << instance.getDrawableCount() << " drawables, " << vertexCount << " vertices" << std::endl;
+		std::cout << "full vertices,  scalar: " << fullScalar * 1e6 / iterations << " us, wide: " << fullWide * 1e6 / iterations << " us (" << fullScalar / fullWide << "x)" << std::endl;
+		std::cout << "positions only, scalar: " << positionsScalar * 1e6 / iterations << " us, wide: " << positionsWide * 1e6 / iterations << " us (" << positionsScalar / positionsWide << "x)" << std::endl;
+		std::cout << "output " << (identical ? "identical" : "DIFFERS") << std::endl;
+	}
+}
+
+int main(int argc, char** argv) {
+	luna::setMessageCallback([](const char* message, const char* prefix, luna::MessageSeverity severity) {
+		std::cout << "<" << prefix << "> " << message << std::endl;
+	});
+
+	int iterations = argc > 1 ? std::stoi(argv[1]) : 10000;
+	std::vector<const char*> modelPaths(argv + std::min(argc, 2), argv + argc);
+	if (modelPaths.empty())
+		modelPaths = { "example/assets/models/hiyori/hiyori_free_t08.model3.json", "example/assets/models/niziiro/mao_pro.model3.json" };
+
+	// the model loads its textures, so it needs a graphics context
+	luna::initialize();
+	luna::live2d::initialize();
+	luna::Window window("Vertex Benchmark", 64, 64);
+
+	for (const char* modelPath : modelPaths)
+		benchmark(modelPath, iterations);
+
+	luna::live2d::terminate();
+	luna::terminate();
+}